@@ -0,0 +1,62 @@
+#!/bin/sh
+# ag: Benchmark of the control message path of faustgen2~. Generates
+# synthetic dsps with the given numbers of controls, each of which has a MIDI
+# ctrl and an OSC binding, loads them into faustgen2~ in a headless Pd and
+# reports the time per message for setting a control by name, MIDI ctl, OSC,
+# and the time per value for list messages, as measured by the 'ctlbench'
+# message of the objects.
+#
+# usage: ctlbench.sh [-pd pd] [-n messages] [ncontrols...]
+#
+# The default numbers of controls are 10 100 1000 10000. The external is taken
+# from the external directory of the source tree; this needs a Pd version
+# which supports the -batch option (0.51 or later).
+
+pd=${PD:-pd}
+count=100000
+external=$(cd "$(dirname "$0")/../external" && pwd)
+
+while [ $# -gt 0 ]; do
+    case $1 in
+	-pd) pd=$2; shift 2;;
+	-n) count=$2; shift 2;;
+	-*) echo "usage: $0 [-pd pd] [-n messages] [ncontrols...]" >&2; exit 2;;
+	*) break;;
+    esac
+done
+[ $# -gt 0 ] || set -- 10 100 1000 10000
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# One object per dsp, all of which get the ctlbench message through the
+# global faustgen2~ receiver once the patch is loaded.
+{
+    echo "#N canvas 0 0 450 300 10;"
+    echo "#X obj 10 10 loadbang;"
+    echo "#X msg 10 30 \\; faustgen2~ ctlbench $count \\; pd quit;"
+    echo "#X connect 0 0 1 0;"
+} > "$dir/ctlbench.pd"
+obj=2
+for n in "$@"; do
+    {
+	echo "declare name \"synth$n\";"
+	echo "process = 0"
+	i=0
+	while [ $i -lt "$n" ]; do
+	    echo "  + hslider(\"p$i[midi:ctrl $((i % 128))][osc:/p/$i 0 1]\", 0, 0, 1, 0.01)"
+	    i=$((i + 1))
+	done
+	echo ";"
+    } > "$dir/synth$n.dsp"
+    cat >> "$dir/ctlbench.pd" <<EOF
+#X obj 10 $((obj * 30)) faustgen2~ synth$n;
+#X obj 10 $((obj * 30 + 15)) print synth$n;
+#X connect $obj 1 $((obj + 1)) 0;
+EOF
+    obj=$((obj + 2))
+done
+
+echo "controls name_ns midi_ns osc_ns list_ns_per_value"
+"$pd" -nogui -nosound -batch -stderr -path "$external" -open "$dir/ctlbench.pd" 2>&1 |
+    awk '$2 == "ctlbench" { print $3, $4, $5, $6, $7 }'
@@ -0,0 +1,677 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+// ag: Headless benchmark of Faust dsp throughput, without Pd. Each dsp file
+// is compiled with each of the given option sets and the resulting instance
+// is run on white noise at each of the given block sizes, the same way
+// faustgen2~ runs it (createCDSPFactoryFromFile, initCDSPInstance,
+// computeCDSPInstance on float or double buffers). Reports the compile time
+// and the time per sample, as text or JSON.
+//
+// With -golden dir, this also works as a regression check: the first
+// samples rendered from a fixed noise input are compared against the golden
+// output stored in dir (which -record writes), and the time per sample
+// against an optional budget in dir (which -record writes if there is none,
+// with some margin). The files are named after the dsp and the options, see
+// bench_golden_path and tests/golden/README.md. The exit status is 1 if any
+// dsp fails to compile, changes its output or exceeds its budget, and 77 if
+// some golden output is missing, but nothing failed.
+//
+// With -perf, the hardware performance counters of the compute calls are
+// reported per sample as well (Linux only, see faust_tilde_perf.h).
+//
+// usage: faustgen-bench [-json] [-perf] [-b 32,64,256] [-n samples]
+//                       [-r samplerate] [-O "options"]...
+//                       [-golden dir [-record] [-tol eps]] file.dsp...
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include <faust/dsp/llvm-c-dsp.h>
+
+#include "faust_tilde_perf.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+#define MAXOPTIONS 64
+#define MAXSETS 16
+#define MAXBLOCKSIZES 16
+#define ERRORSIZE 4096
+#define PATHSIZE 4096
+
+// length of the golden output per channel, and the seed of its input noise
+#define GOLDENSAMPLES 4096
+#define GOLDENSEED 307
+
+// factor between the time measured by -record and the budget it writes
+#define BUDGETMARGIN 4.0
+
+// exit status if some golden output is missing, but nothing failed (this is
+// what ctest takes as a skipped test)
+#define SKIPSTATUS 77
+
+// State of the noise generator. This is the generator of Pd's noise~ (and of
+// the bench message of faustgen2~), so that the golden outputs don't depend
+// on the rand() of the C library.
+static uint32_t bench_seed = GOLDENSEED;
+
+static double bench_noise(void)
+{
+    double const v = ((float)((int32_t)(bench_seed & 0x7fffffff) - 0x40000000)) * (float)(1.0 / 0x40000000);
+    bench_seed = bench_seed * 435898247 + 382842987;
+    return v;
+}
+
+static double bench_gettime(void)
+{
+#ifdef _WIN32
+    LARGE_INTEGER count, freq;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#elif defined(__APPLE__)
+    static double period = 0.0;
+    if(period == 0.0)
+    {
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        period = 1e-9 * (double)info.numer / (double)info.denom;
+    }
+    return (double)mach_absolute_time() * period;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
+typedef struct _bench_options
+{
+    char*       o_text;
+    int         o_argc;
+    char const* o_argv[MAXOPTIONS];
+    int         o_double;
+}t_bench_options;
+
+// Split an option set at blanks, adding the default library path.
+static void bench_options_parse(t_bench_options* x, char* text)
+{
+    char* arg;
+    x->o_text   = strdup(text);
+    x->o_argc   = 0;
+    x->o_double = 0;
+#ifdef FAUSTGEN_BENCH_LIBDIR
+    x->o_argv[x->o_argc++] = "-I";
+    x->o_argv[x->o_argc++] = FAUSTGEN_BENCH_LIBDIR;
+#endif
+    for(arg = strtok(text, " \t"); arg && x->o_argc < MAXOPTIONS; arg = strtok(NULL, " \t"))
+    {
+        x->o_argv[x->o_argc++] = arg;
+        // same test as faust_opt_has_double_precision()
+        if(!strncmp(arg, "-double", 7))
+        {
+            x->o_double = 1;
+        }
+    }
+}
+
+static void bench_json_string(char const* s)
+{
+    putchar('"');
+    for(; *s; ++s)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            printf("\\%c", *s);
+        }
+        else if((unsigned char)*s < 0x20)
+        {
+            printf("\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            putchar(*s);
+        }
+    }
+    putchar('"');
+}
+
+static void** bench_alloc_signals(int nchans, int nsamples, int isdbl)
+{
+    int i, j;
+    size_t const size = isdbl ? sizeof(double) : sizeof(float);
+    void** sigs = (void**)calloc(nchans ? nchans : 1, sizeof(void*));
+    for(i = 0; sigs && i < nchans; ++i)
+    {
+        sigs[i] = malloc(nsamples * size);
+        if(!sigs[i])
+        {
+            return NULL;
+        }
+        // white noise, the outputs just get overwritten
+        for(j = 0; j < nsamples; ++j)
+        {
+            double const v = bench_noise();
+            if(isdbl)
+                ((double*)sigs[i])[j] = v;
+            else
+                ((float*)sigs[i])[j] = (float)v;
+        }
+    }
+    return sigs;
+}
+
+static void bench_free_signals(void** sigs, int nchans)
+{
+    int i;
+    if(sigs)
+    {
+        for(i = 0; i < nchans; ++i)
+        {
+            free(sigs[i]);
+        }
+        free(sigs);
+    }
+}
+
+// Run the instance for nsamples in blocks of blocksize, returns the elapsed
+// time in secs, or a negative value on error. The performance counters, if
+// any, are reset and count the run.
+static double bench_run(llvm_dsp* dsp, int blocksize, long nsamples, int isdbl, t_faust_perf* perf)
+{
+    long n;
+    double start;
+    int const ninputs  = getNumInputsCDSPInstance(dsp);
+    int const noutputs = getNumOutputsCDSPInstance(dsp);
+    void** ins  = bench_alloc_signals(ninputs, blocksize, isdbl);
+    void** outs = bench_alloc_signals(noutputs, blocksize, isdbl);
+    if(!ins || !outs)
+    {
+        bench_free_signals(ins, ninputs);
+        bench_free_signals(outs, noutputs);
+        return -1.0;
+    }
+    // warm up the caches before measuring
+    computeCDSPInstance(dsp, blocksize, (FAUSTFLOAT**)ins, (FAUSTFLOAT**)outs);
+    if(perf)
+    {
+        faust_perf_reset(perf);
+        faust_perf_start(perf);
+    }
+    start = bench_gettime();
+    for(n = 0; n < nsamples; n += blocksize)
+    {
+        computeCDSPInstance(dsp, blocksize, (FAUSTFLOAT**)ins, (FAUSTFLOAT**)outs);
+    }
+    start = bench_gettime() - start;
+    if(perf)
+    {
+        faust_perf_stop(perf, (size_t)n);
+    }
+    bench_free_signals(ins, ninputs);
+    bench_free_signals(outs, noutputs);
+    return start;
+}
+
+// Name of the golden output of a dsp file and option set: the base name of
+// the file, followed by the options with any special characters replaced.
+static void bench_golden_path(char* path, char const* dir, char const* file, char const* options, char const* ext)
+{
+    char const* base = strrchr(file, '/');
+    char const* dot;
+    size_t n;
+#ifdef _WIN32
+    if(strrchr(file, '\\') > base)
+    {
+        base = strrchr(file, '\\');
+    }
+#endif
+    base = base ? base + 1 : file;
+    dot  = strrchr(base, '.');
+    n    = (size_t)snprintf(path, PATHSIZE, "%s/%.*s", dir, dot ? (int)(dot - base) : (int)strlen(base), base);
+    if(*options && n < PATHSIZE - 1)
+    {
+        path[n++] = '_';
+        for(; *options && n < PATHSIZE - 1; ++options)
+        {
+            char const c = *options;
+            path[n++] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '.' ? c : '_';
+        }
+    }
+    snprintf(path + n, PATHSIZE - n, "%s", ext);
+}
+
+// Render GOLDENSAMPLES of each output from seeded noise, in blocks of
+// blocksize, into a newly allocated array of doubles, channel after channel.
+static double* bench_render(llvm_dsp* dsp, int samplerate, int blocksize, int isdbl)
+{
+    int i, j, n;
+    int const ninputs  = getNumInputsCDSPInstance(dsp);
+    int const noutputs = getNumOutputsCDSPInstance(dsp);
+    double* result = (double*)calloc((size_t)(noutputs ? noutputs : 1) * GOLDENSAMPLES, sizeof(double));
+    void** ins;
+    void** outs;
+    void** in  = (void**)malloc((ninputs ? ninputs : 1) * sizeof(void*));
+    void** out = (void**)malloc((noutputs ? noutputs : 1) * sizeof(void*));
+    bench_seed = GOLDENSEED;
+    ins  = bench_alloc_signals(ninputs, GOLDENSAMPLES, isdbl);
+    outs = bench_alloc_signals(noutputs, GOLDENSAMPLES, isdbl);
+    if(!result || !ins || !outs || !in || !out)
+    {
+        free(result);
+        free(in);
+        free(out);
+        bench_free_signals(ins, ninputs);
+        bench_free_signals(outs, noutputs);
+        return NULL;
+    }
+    initCDSPInstance(dsp, samplerate);
+    for(n = 0; n < GOLDENSAMPLES; n += blocksize)
+    {
+        int const count = GOLDENSAMPLES - n < blocksize ? GOLDENSAMPLES - n : blocksize;
+        for(i = 0; i < ninputs; ++i)
+        {
+            in[i] = isdbl ? (void*)((double*)ins[i] + n) : (void*)((float*)ins[i] + n);
+        }
+        for(i = 0; i < noutputs; ++i)
+        {
+            out[i] = isdbl ? (void*)((double*)outs[i] + n) : (void*)((float*)outs[i] + n);
+        }
+        computeCDSPInstance(dsp, count, (FAUSTFLOAT**)in, (FAUSTFLOAT**)out);
+    }
+    for(i = 0; i < noutputs; ++i)
+    {
+        for(j = 0; j < GOLDENSAMPLES; ++j)
+        {
+            result[i * GOLDENSAMPLES + j] = isdbl ? ((double*)outs[i])[j] : ((float*)outs[i])[j];
+        }
+    }
+    free(in);
+    free(out);
+    bench_free_signals(ins, ninputs);
+    bench_free_signals(outs, noutputs);
+    // start the benchmark from a freshly initialized instance
+    initCDSPInstance(dsp, samplerate);
+    return result;
+}
+
+// The golden files hold doubles in little-endian byte order, so that they
+// can be shared between platforms.
+static size_t bench_write_doubles(double const* values, size_t n, FILE* fp)
+{
+    size_t i;
+    int k;
+    for(i = 0; i < n; ++i)
+    {
+        unsigned char bytes[8];
+        uint64_t bits;
+        memcpy(&bits, values + i, 8);
+        for(k = 0; k < 8; ++k)
+        {
+            bytes[k] = (unsigned char)(bits >> (8 * k));
+        }
+        if(fwrite(bytes, 1, 8, fp) != 8)
+        {
+            break;
+        }
+    }
+    return i;
+}
+
+static size_t bench_read_doubles(double* values, size_t n, FILE* fp)
+{
+    size_t i;
+    int k;
+    for(i = 0; i < n; ++i)
+    {
+        unsigned char bytes[8];
+        uint64_t bits = 0;
+        if(fread(bytes, 1, 8, fp) != 8)
+        {
+            break;
+        }
+        for(k = 0; k < 8; ++k)
+        {
+            bits |= (uint64_t)bytes[k] << (8 * k);
+        }
+        memcpy(values + i, &bits, 8);
+    }
+    return i;
+}
+
+// Compare the rendered output against the golden file or record it. Returns
+// the maximum deviation, -2 if there is no golden output, or -1 if it can't
+// be written or has a different number of channels.
+static double bench_golden(char const* path, double const* output, int noutputs, int record)
+{
+    size_t const n = (size_t)noutputs * GOLDENSAMPLES;
+    size_t i;
+    double maxdiff = 0;
+    double* golden;
+    FILE* fp = fopen(path, record ? "wb" : "rb");
+    if(!fp)
+    {
+        return record ? -1.0 : -2.0;
+    }
+    if(record)
+    {
+        size_t const written = bench_write_doubles(output, n, fp);
+        return fclose(fp) || written != n ? -1.0 : 0.0;
+    }
+    golden = (double*)malloc((n + 1) * sizeof(double));
+    // reading one more than expected detects a longer file
+    if(!golden || bench_read_doubles(golden, n + 1, fp) != n)
+    {
+        free(golden);
+        fclose(fp);
+        return -1.0;
+    }
+    fclose(fp);
+    for(i = 0; i < n; ++i)
+    {
+        double const diff = output[i] > golden[i] ? output[i] - golden[i] : golden[i] - output[i];
+        // a NaN never compares greater, so check for it explicitly
+        if(diff > maxdiff || diff != diff)
+        {
+            maxdiff = diff != diff ? 1e300 : diff;
+        }
+    }
+    free(golden);
+    return maxdiff;
+}
+
+// Budget in ns/sample from the budget file, 0 if there is none.
+static double bench_budget(char const* path)
+{
+    double budget = 0;
+    FILE* fp = fopen(path, "r");
+    if(fp)
+    {
+        if(fscanf(fp, "%lf", &budget) != 1)
+        {
+            budget = 0;
+        }
+        fclose(fp);
+    }
+    return budget;
+}
+
+// Write a budget file with some margin over the measured time, unless there
+// already is one (which may have been adjusted by hand).
+static int bench_record_budget(char const* path, double nspersample)
+{
+    FILE* fp = fopen(path, "r");
+    if(fp)
+    {
+        fclose(fp);
+        return 0;
+    }
+    fp = fopen(path, "w");
+    if(!fp)
+    {
+        return -1;
+    }
+    fprintf(fp, "%.1f\n", nspersample * BUDGETMARGIN);
+    return fclose(fp) ? -1 : 0;
+}
+
+static void bench_usage(void)
+{
+    fprintf(stderr, "usage: faustgen-bench [-json] [-perf] [-b blocksizes] [-n samples] [-r samplerate] [-O options]...\n"
+            "                      [-golden dir [-record] [-tol eps]] file.dsp...\n"
+            "  -json          output JSON instead of text\n"
+            "  -perf          report hardware performance counters per sample (Linux only)\n"
+            "  -b 32,64,256   comma-separated list of block sizes (default 64)\n"
+            "  -n samples     number of samples per run (default 10 secs of audio)\n"
+            "  -r samplerate  sample rate (default 48000)\n"
+            "  -O options     Faust compile options, may be given repeatedly to compare option sets\n"
+            "  -golden dir    check the output against the golden output in dir/<name>_<options>.raw,\n"
+            "                 and the time against the budget in ns/sample in dir/<name>_<options>.budget,\n"
+            "                 if any (without options, just dir/<name>.raw and dir/<name>.budget)\n"
+            "  -record        write the golden output instead of checking it, and a budget if there is none\n"
+            "  -tol eps       maximum deviation from the golden output (default 1e-6)\n");
+}
+
+int main(int argc, char** argv)
+{
+    int i, j, k, l, nsets = 0, nblocksizes = 0, json = 0, first = 1, status = 0, skipped = 0;
+    int blocksizes[MAXBLOCKSIZES];
+    int samplerate = 48000, record = 0;
+    long nsamples = 0;
+    double tolerance = 1e-6;
+    t_faust_perf* perf = NULL;
+    char const* goldendir = NULL;
+    t_bench_options sets[MAXSETS];
+
+    for(i = 1; i < argc && argv[i][0] == '-'; ++i)
+    {
+        if(!strcmp(argv[i], "-json"))
+        {
+            json = 1;
+        }
+        else if(!strcmp(argv[i], "-perf"))
+        {
+            perf = faust_perf_new();
+            if(!perf)
+            {
+                fprintf(stderr, "faustgen-bench: performance counters not available (%s)\n", strerror(errno));
+                return 2;
+            }
+        }
+        else if(!strcmp(argv[i], "-b") && i + 1 < argc)
+        {
+            char* arg;
+            for(arg = strtok(argv[++i], ","); arg && nblocksizes < MAXBLOCKSIZES; arg = strtok(NULL, ","))
+            {
+                int const n = atoi(arg);
+                if(n > 0)
+                {
+                    blocksizes[nblocksizes++] = n;
+                }
+            }
+        }
+        else if(!strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            nsamples = atol(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-r") && i + 1 < argc)
+        {
+            samplerate = atoi(argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-O") && i + 1 < argc && nsets < MAXSETS)
+        {
+            bench_options_parse(sets + nsets++, argv[++i]);
+        }
+        else if(!strcmp(argv[i], "-golden") && i + 1 < argc)
+        {
+            goldendir = argv[++i];
+        }
+        else if(!strcmp(argv[i], "-record"))
+        {
+            record = 1;
+        }
+        else if(!strcmp(argv[i], "-tol") && i + 1 < argc)
+        {
+            tolerance = atof(argv[++i]);
+        }
+        else
+        {
+            bench_usage();
+            return 2;
+        }
+    }
+    if(i == argc || samplerate <= 0)
+    {
+        bench_usage();
+        return 2;
+    }
+    if(!nblocksizes)
+    {
+        blocksizes[nblocksizes++] = 64;
+    }
+    if(!nsets)
+    {
+        char none[] = "";
+        bench_options_parse(sets + nsets++, none);
+    }
+    if(nsamples <= 0)
+    {
+        nsamples = 10L * samplerate;
+    }
+
+    if(json)
+    {
+        printf("{\"faust\":");
+        bench_json_string(getCLibFaustVersion());
+        printf(",\"samplerate\":%d,\"samples\":%ld,\"results\":[", samplerate, nsamples);
+    }
+    for(; i < argc; ++i)
+    {
+        for(j = 0; j < nsets; ++j)
+        {
+            char errors[ERRORSIZE];
+            llvm_dsp_factory* factory;
+            llvm_dsp* dsp;
+            double budget;
+            char budgetpath[PATHSIZE];
+            double compile = bench_gettime();
+            *errors = 0;
+            factory = createCDSPFactoryFromFile(argv[i], sets[j].o_argc, sets[j].o_argv, "", errors, -1);
+            compile = bench_gettime() - compile;
+            if(!factory || *errors)
+            {
+                fprintf(stderr, "faustgen-bench: %s: %s\n", argv[i], errors);
+                status = 1;
+                continue;
+            }
+            dsp = createCDSPInstance(factory);
+            if(!dsp)
+            {
+                fprintf(stderr, "faustgen-bench: %s: can't create instance\n", argv[i]);
+                deleteCDSPFactory(factory);
+                status = 1;
+                continue;
+            }
+            initCDSPInstance(dsp, samplerate);
+            budget = 0;
+            if(goldendir)
+            {
+                char path[PATHSIZE];
+                double* output = bench_render(dsp, samplerate, blocksizes[0], sets[j].o_double);
+                double deviation = -1.0;
+                bench_golden_path(path, goldendir, argv[i], sets[j].o_text, ".raw");
+                if(output)
+                {
+                    deviation = bench_golden(path, output, getNumOutputsCDSPInstance(dsp), record);
+                    free(output);
+                }
+                if(deviation == -2.0)
+                {
+                    fprintf(stderr, "faustgen-bench: %s: no golden output %s, skipped (record it with -record)\n",
+                            argv[i], path);
+                    skipped = 1;
+                }
+                else if(deviation < 0)
+                {
+                    fprintf(stderr, "faustgen-bench: %s: can't %s golden output %s\n", argv[i],
+                            record ? "write" : "read", path);
+                    status = 1;
+                }
+                else if(deviation > tolerance)
+                {
+                    fprintf(stderr, "faustgen-bench: %s [%s]: output deviates from golden output by %g\n",
+                            argv[i], sets[j].o_text, deviation);
+                    status = 1;
+                }
+                bench_golden_path(budgetpath, goldendir, argv[i], sets[j].o_text, ".budget");
+                budget = record ? 0 : bench_budget(budgetpath);
+            }
+            for(k = 0; k < nblocksizes; ++k)
+            {
+                double const elapsed = bench_run(dsp, blocksizes[k], nsamples, sets[j].o_double, perf);
+                // samples actually computed, including the last partial block
+                long const n = (nsamples + blocksizes[k] - 1) / blocksizes[k] * blocksizes[k];
+                double const nspersample = elapsed * 1e9 / (double)n;
+                double const realtime = elapsed > 0 ? (double)n / samplerate / elapsed : 0;
+                if(elapsed < 0)
+                {
+                    fprintf(stderr, "faustgen-bench: %s: memory allocation failed\n", argv[i]);
+                    status = 1;
+                    continue;
+                }
+                if(goldendir && record && k == 0 && bench_record_budget(budgetpath, nspersample))
+                {
+                    fprintf(stderr, "faustgen-bench: %s: can't write budget %s\n", argv[i], budgetpath);
+                    status = 1;
+                }
+                if(budget > 0 && nspersample > budget)
+                {
+                    fprintf(stderr, "faustgen-bench: %s [%s] block %d: %.3f ns/sample exceeds the budget of %g\n",
+                            argv[i], sets[j].o_text, blocksizes[k], nspersample, budget);
+                    status = 1;
+                }
+                if(json)
+                {
+                    printf("%s\n{\"dsp\":", first ? "" : ",");
+                    bench_json_string(argv[i]);
+                    printf(",\"options\":");
+                    bench_json_string(sets[j].o_text);
+                    printf(",\"double\":%s,\"inputs\":%d,\"outputs\":%d,\"blocksize\":%d,"
+                           "\"compile_ms\":%.3f,\"ns_per_sample\":%.3f,\"realtime\":%.1f",
+                           sets[j].o_double ? "true" : "false",
+                           getNumInputsCDSPInstance(dsp), getNumOutputsCDSPInstance(dsp),
+                           blocksizes[k], compile * 1000.0, nspersample, realtime);
+                    for(l = 0; perf && l < FAUST_PERF_NCOUNTERS; ++l)
+                    {
+                        double const count = faust_perf_get(perf, l);
+                        printf(count < 0 ? ",\"%s\":null" : ",\"%s\":%.3f", faust_perf_get_name(l), count);
+                    }
+                    printf("}");
+                }
+                else
+                {
+                    printf("%s [%s] block %d: compile %.3f ms, %.3f ns/sample, %.1fx realtime",
+                           argv[i], sets[j].o_text, blocksizes[k], compile * 1000.0,
+                           nspersample, realtime);
+                    for(l = 0; perf && l < FAUST_PERF_NCOUNTERS; ++l)
+                    {
+                        double const count = faust_perf_get(perf, l);
+                        if(count >= 0)
+                        {
+                            printf(", %.3f %s", count, faust_perf_get_name(l));
+                        }
+                    }
+                    printf("\n");
+                }
+                first = 0;
+            }
+            deleteCDSPInstance(dsp);
+            deleteCDSPFactory(factory);
+        }
+    }
+    if(json)
+    {
+        printf("\n]}\n");
+    }
+    for(j = 0; j < nsets; ++j)
+    {
+        free(sets[j].o_text);
+    }
+    if(perf)
+    {
+        faust_perf_free(perf);
+    }
+    return status ? status : skipped ? SKIPSTATUS : 0;
+}
@@ -0,0 +1,138 @@
+#!/bin/sh
+# ag: Scaling benchmark for large numbers of faustgen2~ instances. For each
+# dsp and each instance count, generates a patch with that many instances
+# and runs it in a headless Pd, which reports:
+#
+# - load_ms: time to load the patch, i.e., create all the objects (compile,
+#   make_unique_name and binding the receivers)
+# - dspon_ms: time to rebuild the dsp graph ('pd dsp 1')
+# - fanout_ms: time for a message sent to all objects through the global
+#   faustgen2~ receiver
+# - memory_kb: memory used by the objects, as reported by 'stats'
+# - tick_us: compute time of all instances per dsp tick of 64 samples
+#
+# The results are printed as a table with one line per dsp and instance
+# count, which is also written to file.dat with -o file; if gnuplot is
+# available, the curves are then plotted to file.png as well.
+#
+# usage: scaling.sh [-pd pd] [-s secs] [-o file] [-N "counts"] [file.dsp...]
+#
+# The default instance counts are 100 500 1000 2000, the default dsps are
+# some of the examples. This needs a Pd version which supports the -batch
+# option (0.51 or later).
+
+srcdir=$(cd "$(dirname "$0")/.." && pwd)
+pd=${PD:-pd}
+secs=10
+out=
+counts="100 500 1000 2000"
+samplerate=48000
+
+while [ $# -gt 0 ]; do
+    case $1 in
+	-pd) pd=$2; shift 2;;
+	-s) secs=$2; shift 2;;
+	-o) out=$2; shift 2;;
+	-N) counts=$2; shift 2;;
+	-*) echo "usage: $0 [-pd pd] [-s secs] [-o file] [-N \"counts\"] [file.dsp...]" >&2; exit 2;;
+	*) break;;
+    esac
+done
+[ $# -gt 0 ] || set -- "$srcdir/external/examples/gain.dsp" "$srcdir/external/examples/chorus.dsp" "$srcdir/external/examples/freeverb.dsp"
+
+dir=$(mktemp -d) || exit 1
+trap 'rm -rf "$dir"' EXIT
+
+# The main patch times the loading of the instances patch, switching dsp on
+# and a message to all objects, then lets the dsp run for the given time,
+# queries the statistics and quits. The outlets of the trigger fire from
+# right to left.
+cat > "$dir/scaling.pd" <<EOF
+#N canvas 0 0 450 300 10;
+#X obj 10 10 loadbang;
+#X obj 10 30 t b b b b b b b b b b;
+#X obj 10 60 realtime;
+#X msg 100 60 \\; pd open instances.pd $dir;
+#X obj 10 80 print load;
+#X obj 10 110 realtime;
+#X msg 100 110 \\; pd dsp 1;
+#X obj 10 130 print dspon;
+#X obj 10 160 realtime;
+#X msg 100 160 \\; faustgen2~ stats 1;
+#X obj 10 180 print fanout;
+#X obj 10 210 delay $((secs * 1000));
+#X msg 10 230 \\; faustgen2~ stats scaling-stats;
+#X obj 100 230 delay 10;
+#X msg 100 250 \\; pd quit;
+#X obj 10 280 r scaling-stats;
+#X obj 10 300 print stats;
+#X connect 0 0 1 0;
+#X connect 1 9 2 0;
+#X connect 1 8 3 0;
+#X connect 1 7 2 1;
+#X connect 1 6 5 0;
+#X connect 1 5 6 0;
+#X connect 1 4 5 1;
+#X connect 1 3 8 0;
+#X connect 1 2 9 0;
+#X connect 1 1 8 1;
+#X connect 1 0 11 0;
+#X connect 2 0 4 0;
+#X connect 5 0 7 0;
+#X connect 8 0 10 0;
+#X connect 11 0 12 0;
+#X connect 11 0 13 0;
+#X connect 13 0 14 0;
+#X connect 15 0 16 0;
+EOF
+
+result() {
+    echo "dsp instances load_ms load_per_instance_ms dspon_ms fanout_ms memory_kb tick_us"
+    for dsp in "$@"; do
+	name=$(basename "$dsp" .dsp)
+	cp "$dsp" "$dir/$name.dsp" || exit 1
+	for n in $counts; do
+	    {
+		echo "#N canvas 0 0 450 300 10;"
+		i=0
+		while [ $i -lt "$n" ]; do
+		    echo "#X obj $((10 + i % 20 * 20)) $((10 + i / 20 * 20)) faustgen2~ $name;"
+		    i=$((i + 1))
+		done
+	    } > "$dir/instances.pd"
+	    "$pd" -nogui -nosound -batch -stderr -r $samplerate -path "$srcdir/external" \
+		  -open "$dir/scaling.pd" 2>&1 |
+		awk -v name="$name" -v n="$n" -v ticks=$((secs * samplerate / 64)) '
+		    $1 == "load:" { load = $2 }
+		    $1 == "dspon:" { dspon = $2 }
+		    $1 == "fanout:" { fanout = $2 }
+		    # total instances compiles compile_ms hits memory compute_ms
+		    $1 == "stats:" && $2 == "total" { memory = $7; compute = $8 }
+		    END {
+			printf "%s %d %.1f %.3f %.1f %.3f %.0f %.2f\n", name, n, load, load / n,
+			       dspon, fanout, memory / 1024, compute * 1000 / ticks
+		    }'
+	done
+    done
+}
+
+if [ -z "$out" ]; then
+    result "$@"
+    exit
+fi
+result "$@" | tee "$out.dat"
+if command -v gnuplot >/dev/null; then
+    dsps=$(awk 'NR > 1 { print $1 }' "$out.dat" | sort -u | tr '\n' ' ')
+    {
+	echo "set terminal png size 1200,800"
+	echo "set output \"$out.png\""
+	echo "set multiplot layout 2,2"
+	echo "set key left top"
+	echo "set xlabel \"instances\""
+	for plot in "3:load time (ms)" "5:dsp on (ms)" "7:memory (kB)" "8:compute time per tick (us)"; do
+	    echo "set title \"${plot#*:}\""
+	    echo "plot for [d in \"$dsps\"] \"$out.dat\" using 2:(strcol(1) eq d ? \$${plot%%:*} : NaN) with linespoints title d"
+	done
+	echo "unset multiplot"
+    } | gnuplot
+fi
@@ -24,9 +24,20 @@ typedef struct _faust_io_manager
     t_outlet**  f_outlets;
     t_outlet*   f_extra_outlet;
     
+    // ag: number of Faust input and output channels; these are the same as
+    // the number of signal iolets, unless we're using multichannel signals,
+    // in which case the channels are packed into f_ngroups iolets
+    size_t      f_ninputs;
+    size_t      f_noutputs;
+    size_t      f_ngroups;
+    
     char        f_valid;
 }t_faust_io_manager;
 
+// Pd 0.54+ multichannel support. signal_setmultiout() is looked up at
+// runtime, so that the external still loads in older Pd versions.
+static t_setmultiout faust_io_setmultiout = NULL;
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //                                      PURE DATA IO DYNAMIC                                    //
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -89,7 +100,7 @@ static char faust_io_manager_resize_inputs(t_faust_io_manager *x, size_t const n
 {
     t_inlet** ninlets;
     size_t i;
-    size_t const cins = faust_io_manager_get_ninputs(x);
+    size_t const cins = x->f_ninlets;
     size_t const rnins = nins;
     if(rnins == cins)
     {
@@ -123,7 +134,7 @@ static char faust_io_manager_resize_outputs(t_faust_io_manager *x, size_t const
 {
     t_outlet** noutlets;
     size_t i;
-    size_t const couts = faust_io_manager_get_noutputs(x);
+    size_t const couts = x->f_noutlets;
     size_t const rnouts = nouts;
     
     if(rnouts == couts)
@@ -171,6 +182,9 @@ t_faust_io_manager* faust_io_manager_new(t_object* owner, t_canvas* canvas)
         x->f_inlets         = NULL;
         x->f_noutlets       = 0;
         x->f_outlets        = NULL;
+        x->f_ninputs        = 0;
+        x->f_noutputs       = 0;
+        x->f_ngroups        = 0;
         x->f_extra_outlet   = outlet_new((t_object *)x->f_owner, NULL);
         x->f_valid          = 0;
         if(!x->f_extra_outlet)
@@ -192,14 +206,29 @@ void faust_io_manager_free(t_faust_io_manager* x)
     freebytes(x, sizeof(t_faust_io_manager));
 }
 
+void faust_io_manager_setup(t_setmultiout setmultiout)
+{
+    faust_io_setmultiout = setmultiout;
+}
+
+char faust_io_manager_has_multichannel(void)
+{
+    return faust_io_setmultiout != NULL;
+}
+
+void faust_io_manager_set_multichannel(t_faust_io_manager *x, size_t ngroups)
+{
+    x->f_ngroups = faust_io_setmultiout ? ngroups : 0;
+}
+
 size_t faust_io_manager_get_ninputs(t_faust_io_manager const *x)
 {
-    return x->f_ninlets;
+    return x->f_ninputs;
 }
 
 size_t faust_io_manager_get_noutputs(t_faust_io_manager const *x)
 {
-    return x->f_noutlets;
+    return x->f_noutputs;
 }
 
 t_outlet* faust_io_manager_get_extra_output(t_faust_io_manager *x)
@@ -215,9 +244,17 @@ char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nout
     {
         gobj_vis((t_gobj *)x->f_owner, x->f_canvas, 0);
     }
-    valid += faust_io_manager_resize_inputs(x, (size_t)nins);
-    valid += faust_io_manager_resize_outputs(x, (size_t)nouts);
+    // ag: with multichannel signals, each group of channels gets one iolet
+    // (assuming that the number of channels is divisible by f_ngroups)
+    if(x->f_ngroups && (nins % x->f_ngroups || nouts % x->f_ngroups))
+    {
+        x->f_ngroups = 0;
+    }
+    valid += faust_io_manager_resize_inputs(x, x->f_ngroups && nins ? x->f_ngroups : (size_t)nins);
+    valid += faust_io_manager_resize_outputs(x, x->f_ngroups && nouts ? x->f_ngroups : (size_t)nouts);
     valid += faust_io_manager_resize_signals(x, (size_t)nins + (size_t)nouts);
+    x->f_ninputs  = (size_t)nins;
+    x->f_noutputs = (size_t)nouts;
     if(redraw)
     {
         gobj_vis((t_gobj *)x->f_owner, x->f_canvas, 1);
@@ -231,7 +268,8 @@ char faust_io_manager_init(t_faust_io_manager *x, int const nins, int const nout
 
 static char faust_io_manager_is_valid(t_faust_io_manager *x)
 {
-    if(!x->f_signals || !x->f_valid)
+    // ag: a dsp without any inputs and outputs has no signals at all
+    if((!x->f_signals && x->f_nsignals) || !x->f_valid)
     {
         pd_error(x->f_owner, "faustgen2~: something wrong happened during iolets allocation");
         return 0;
@@ -251,9 +289,9 @@ static char faust_io_manager_is_valid(t_faust_io_manager *x)
         pd_error(x->f_owner, "faustgen2~: number of signal outlets %i incompatible with internal %i", (int)x->f_noutlets, (int)obj_nsigoutlets(x->f_owner));
         return 0;
     }
-    if(x->f_ninlets + x->f_noutlets != x->f_nsignals)
+    if(x->f_ninputs + x->f_noutputs != x->f_nsignals)
     {
-        pd_error(x->f_owner, "faustgen2~: number of signals %i incompatible with number of iolets %i", (int)x->f_nsignals, (int)(x->f_ninlets + x->f_noutlets));
+        pd_error(x->f_owner, "faustgen2~: number of signals %i incompatible with number of channels %i", (int)x->f_nsignals, (int)(x->f_ninputs + x->f_noutputs));
         return 0;
     }
     return 1;
@@ -266,9 +304,47 @@ char faust_io_manager_prepare(t_faust_io_manager *x, t_signal **sp)
     {
         return 1;
     }
+#ifdef CLASS_MULTICHANNEL
+    if(faust_io_setmultiout)
+    {
+        // ag: In Pd 0.54+ the class is multichannel-aware, so we need to
+        // create all output signals ourselves, and the input signals may
+        // have any number of channels. Each iolet carries a contiguous block
+        // of nchans channels. Inputs with fewer channels are wrapped around,
+        // so that, e.g., a mono signal is fed into all channels of the inlet.
+        size_t const nichans = x->f_ninlets ? x->f_ninputs / x->f_ninlets : 0;
+        size_t const nochans = x->f_noutlets ? x->f_noutputs / x->f_noutlets : 0;
+        size_t c;
+        for(i = 0; i < x->f_noutlets; ++i)
+        {
+            faust_io_setmultiout(&sp[x->f_ninlets+i], (int)nochans);
+        }
+        for(i = 0; i < x->f_ninlets; ++i)
+        {
+            t_signal *sig = sp[i];
+            int const n = sig->s_nchans > 0 ? sig->s_nchans : 1;
+            for(c = 0; c < nichans; ++c)
+            {
+                x->f_signals[i*nichans+c] = sig->s_vec ? sig->s_vec + (c % n) * sig->s_n : NULL;
+            }
+        }
+        for(i = 0; i < x->f_noutlets; ++i)
+        {
+            t_signal *sig = sp[x->f_ninlets+i];
+            for(c = 0; c < nochans; ++c)
+            {
+                x->f_signals[x->f_ninputs+i*nochans+c] = sig->s_vec ? sig->s_vec + c * sig->s_n : NULL;
+            }
+        }
+    }
+    else
+#endif
     for(i = 0; i < x->f_nsignals; ++i)
     {
         x->f_signals[i] = sp[i]->s_vec;
+    }
+    for(i = 0; i < x->f_nsignals; ++i)
+    {
         if(x->f_signals[i] == NULL)
         {
             pd_error(x->f_owner, "faustgen2~: the signal vector %i is empty", (int)i);
@@ -285,10 +361,14 @@ t_sample** faust_io_manager_get_input_signals(t_faust_io_manager *x)
 
 t_sample** faust_io_manager_get_output_signals(t_faust_io_manager *x)
 {
-    return x->f_signals+x->f_ninlets;
+    return x->f_signals+x->f_ninputs;
 }
 
 void faust_io_manager_print(t_faust_io_manager const* x, char const log)
 {
     logpost(x->f_owner, 2+log, "%i inputs, %i outputs", (int)faust_io_manager_get_ninputs(x), (int)faust_io_manager_get_noutputs(x));
+    if(x->f_ngroups)
+    {
+        logpost(x->f_owner, 2+log, "multichannel iolets: %i inlets, %i outlets", (int)x->f_ninlets, (int)x->f_noutlets);
+    }
 }
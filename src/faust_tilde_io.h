@@ -12,8 +12,19 @@
 struct _faust_io_manager;
 typedef struct _faust_io_manager t_faust_io_manager;
 
+// Pd 0.54+ multichannel support, pass signal_setmultiout() if available.
+typedef void (*t_setmultiout)(t_signal **sig, int nchans);
+
+void faust_io_manager_setup(t_setmultiout setmultiout);
+
+char faust_io_manager_has_multichannel(void);
+
 t_faust_io_manager* faust_io_manager_new(t_object* owner, t_canvas* canvas);
 
+// Pack the channels into ngroups multichannel iolets (0 = one iolet per
+// channel). This takes effect with the next faust_io_manager_init().
+void faust_io_manager_set_multichannel(t_faust_io_manager *x, size_t ngroups);
+
 void faust_io_manager_free(t_faust_io_manager* x);
 
 size_t faust_io_manager_get_ninputs(t_faust_io_manager const *x);
@@ -0,0 +1,245 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_perf.h"
+#include <stdlib.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static char const* faust_perf_names[FAUST_PERF_NCOUNTERS] =
+{
+    "cycles", "instructions", "cache-misses", "branch-misses"
+};
+
+struct _faust_perf
+{
+#ifdef __linux__
+    // the counters of the group, -1 if not available; f_leader is the group
+    // leader, f_index the position of each counter in the group
+    int         f_fds[FAUST_PERF_NCOUNTERS];
+    int         f_index[FAUST_PERF_NCOUNTERS];
+    int         f_leader;
+    int         f_ncounters;
+    // the thread which the counters were opened for
+    pthread_t   f_thread;
+    char        f_opened;
+#endif
+    size_t      f_nsamples;
+};
+
+char const* faust_perf_get_name(int counter)
+{
+    return counter >= 0 && counter < FAUST_PERF_NCOUNTERS ? faust_perf_names[counter] : "";
+}
+
+#ifdef __linux__
+
+static unsigned long long const faust_perf_configs[FAUST_PERF_NCOUNTERS] =
+{
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+};
+
+static void faust_perf_close(t_faust_perf* x)
+{
+    int i;
+    for(i = 0; i < FAUST_PERF_NCOUNTERS; ++i)
+    {
+        if(x->f_fds[i] >= 0)
+        {
+            close(x->f_fds[i]);
+        }
+        x->f_fds[i] = x->f_index[i] = -1;
+    }
+    x->f_leader = -1;
+    x->f_ncounters = 0;
+    x->f_opened = 0;
+}
+
+// Open the counters for the calling thread, as one group, so that they can
+// be started and stopped together with a single system call each. A counter
+// which isn't supported (e.g., in a VM) is left out of the group, so that it
+// doesn't disable the others. Returns the number of counters, with errno set
+// if there are none.
+static int faust_perf_open(t_faust_perf* x)
+{
+    int i, err = 0;
+    faust_perf_close(x);
+    for(i = 0; i < FAUST_PERF_NCOUNTERS; ++i)
+    {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = faust_perf_configs[i];
+        attr.disabled       = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        // the kernel may multiplex the group with others, so we scale by the
+        // running time
+        attr.read_format    = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        x->f_fds[i] = (int)syscall(__NR_perf_event_open, &attr, 0, -1, x->f_leader, 0);
+        if(x->f_fds[i] < 0)
+        {
+            err = errno;
+            continue;
+        }
+        if(x->f_leader < 0)
+        {
+            x->f_leader = x->f_fds[i];
+        }
+        x->f_index[i] = x->f_ncounters++;
+    }
+    x->f_thread = pthread_self();
+    x->f_opened = 1;
+    if(!x->f_ncounters)
+    {
+        errno = err;
+    }
+    return x->f_ncounters;
+}
+
+t_faust_perf* faust_perf_new(void)
+{
+    int i;
+    t_faust_perf* x = (t_faust_perf*)malloc(sizeof(t_faust_perf));
+    if(!x)
+    {
+        return NULL;
+    }
+    for(i = 0; i < FAUST_PERF_NCOUNTERS; ++i)
+    {
+        x->f_fds[i] = -1;
+    }
+    // check that the counters are available; they're opened again by the
+    // thread which starts them
+    if(!faust_perf_open(x))
+    {
+        int const err = errno;
+        free(x);
+        errno = err;
+        return NULL;
+    }
+    faust_perf_close(x);
+    x->f_nsamples = 0;
+    return x;
+}
+
+void faust_perf_free(t_faust_perf* x)
+{
+    faust_perf_close(x);
+    free(x);
+}
+
+void faust_perf_reset(t_faust_perf* x)
+{
+    if(x->f_leader >= 0)
+    {
+        ioctl(x->f_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    }
+    x->f_nsamples = 0;
+}
+
+void faust_perf_start(t_faust_perf* x)
+{
+    if(!x->f_opened || !pthread_equal(x->f_thread, pthread_self()))
+    {
+        // first start, or the dsp now runs in another thread (e.g., after
+        // switching to Pd's callback scheduler); the counts of the previous
+        // thread are lost
+        faust_perf_open(x);
+        x->f_nsamples = 0;
+    }
+    if(x->f_leader >= 0)
+    {
+        ioctl(x->f_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+}
+
+void faust_perf_stop(t_faust_perf* x, size_t nsamples)
+{
+    if(x->f_leader >= 0)
+    {
+        ioctl(x->f_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    }
+    x->f_nsamples += nsamples;
+}
+
+double faust_perf_get(t_faust_perf const* x, int counter)
+{
+    // number of counters, time enabled, time running, counter values
+    uint64_t values[3 + FAUST_PERF_NCOUNTERS];
+    ssize_t const size = (ssize_t)((3 + x->f_ncounters) * sizeof(uint64_t));
+    if(counter < 0 || counter >= FAUST_PERF_NCOUNTERS)
+    {
+        return -1.0;
+    }
+    if(!x->f_opened)
+    {
+        // not started yet
+        return 0.0;
+    }
+    if(x->f_index[counter] < 0 || read(x->f_leader, values, sizeof(values)) != size)
+    {
+        return -1.0;
+    }
+    if(!x->f_nsamples || !values[2])
+    {
+        return 0.0;
+    }
+    return (double)values[3 + x->f_index[counter]] * ((double)values[1] / (double)values[2]) / (double)x->f_nsamples;
+}
+
+#else
+
+t_faust_perf* faust_perf_new(void)
+{
+    errno = ENOSYS;
+    return NULL;
+}
+
+void faust_perf_free(t_faust_perf* x)
+{
+    free(x);
+}
+
+void faust_perf_reset(t_faust_perf* x)
+{
+    x->f_nsamples = 0;
+}
+
+void faust_perf_start(t_faust_perf* x)
+{
+    (void)x;
+}
+
+void faust_perf_stop(t_faust_perf* x, size_t nsamples)
+{
+    x->f_nsamples += nsamples;
+}
+
+double faust_perf_get(t_faust_perf const* x, int counter)
+{
+    (void)x;
+    (void)counter;
+    return -1.0;
+}
+
+#endif
+
+size_t faust_perf_get_samples(t_faust_perf const* x)
+{
+    return x->f_nsamples;
+}
@@ -0,0 +1,52 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_PERF_H
+#define FAUST_TILDE_PERF_H
+
+#include <stddef.h>
+
+// ag: Hardware performance counters (cycles, instructions, cache misses and
+// branch misses) for the compute calls, using perf_event_open on Linux. The
+// counters form a single group, which is started and stopped with one system
+// call each. They only count the thread which starts them (the dsp thread,
+// which may differ from the thread creating them, e.g., with Pd's callback
+// scheduler), and only while they're started. This doesn't depend on Pd, so
+// that the benchmark tool can use it, too. On other systems, or if the kernel doesn't permit access to the
+// counters (see /proc/sys/kernel/perf_event_paranoid), creating them fails.
+
+enum
+{
+    FAUST_PERF_CYCLES,
+    FAUST_PERF_INSTRUCTIONS,
+    FAUST_PERF_CACHE_MISSES,
+    FAUST_PERF_BRANCH_MISSES,
+    FAUST_PERF_NCOUNTERS
+};
+
+struct _faust_perf;
+typedef struct _faust_perf t_faust_perf;
+
+// Returns NULL with errno set if none of the counters is available.
+t_faust_perf* faust_perf_new(void);
+
+void faust_perf_free(t_faust_perf* x);
+
+void faust_perf_reset(t_faust_perf* x);
+
+void faust_perf_start(t_faust_perf* x);
+
+// Stop counting, nsamples is the number of samples computed since the start.
+void faust_perf_stop(t_faust_perf* x, size_t nsamples);
+
+size_t faust_perf_get_samples(t_faust_perf const* x);
+
+// Count per sample, or -1 if the counter isn't available.
+double faust_perf_get(t_faust_perf const* x, int counter);
+
+char const* faust_perf_get_name(int counter);
+
+#endif
@@ -0,0 +1,487 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_render.h"
+#include "faust_tilde_stats.h"
+#include <string.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// Number of samples computed per call when rendering.
+#define FAUST_RENDER_BLOCKSIZE 4096
+// Renders with more samples than this in all channels run on a thread,
+// benches always do.
+#define FAUST_RENDER_THREAD_SIZE (1L << 20)
+// Polling interval for the worker thread (msec).
+#define FAUST_RENDER_POLL_TIME 10
+
+typedef struct _faust_render
+{
+    t_object*   f_owner;
+    llvm_dsp*   f_dsp;
+    char        f_isdbl;
+    int         f_samplerate;
+    long        f_nsamples;
+    int         f_blocksize;
+    long        f_nblocks;
+    double      f_elapsed;
+    int         f_ninputs;
+    int         f_noutputs;
+    void**      f_sigs;
+    int         f_nouts;
+    t_symbol**  f_outs;
+    t_outlet*   f_out;
+    t_symbol*   f_sel;
+    double      f_start;
+    t_clock*    f_clock;
+    char        f_threaded;
+#ifdef _WIN32
+    HANDLE      f_thread;
+    volatile LONG f_cancel;
+#else
+    pthread_t   f_thread;
+    pthread_mutex_t f_mutex;
+    char        f_running;
+    char        f_cancel;
+#endif
+}t_faust_render;
+
+static t_garray* faust_render_get_array(t_object* owner, t_symbol* name)
+{
+    t_garray* a = (t_garray *)pd_findbyclass(name, garray_class);
+    if(!a)
+    {
+        pd_error(owner, "faustgen2~: render: array %s not found", name->s_name);
+    }
+    return a;
+}
+
+// Whether the owner wants the worker thread to stop early.
+static char faust_render_cancelled(t_faust_render* x)
+{
+    char cancel;
+    if(!x->f_threaded)
+    {
+        return 0;
+    }
+#ifdef _WIN32
+    cancel = InterlockedCompareExchange(&x->f_cancel, 0, 0) != 0;
+#else
+    pthread_mutex_lock(&x->f_mutex);
+    cancel = x->f_cancel;
+    pthread_mutex_unlock(&x->f_mutex);
+#endif
+    return cancel;
+}
+
+// Bench mode: compute the blocks over and over on the same buffers.
+static void faust_render_bench(t_faust_render* x)
+{
+    long k;
+    double start;
+    FAUSTFLOAT** ins = (FAUSTFLOAT**)x->f_sigs;
+    FAUSTFLOAT** outs = (FAUSTFLOAT**)x->f_sigs + x->f_ninputs;
+    // warm up the caches before measuring
+    computeCDSPInstance(x->f_dsp, x->f_blocksize, ins, outs);
+    start = faust_stats_gettime();
+    for(k = 0; k < x->f_nblocks; ++k)
+    {
+        computeCDSPInstance(x->f_dsp, x->f_blocksize, ins, outs);
+        if(!(k & 1023) && faust_render_cancelled(x))
+        {
+            break;
+        }
+    }
+    x->f_elapsed = faust_stats_gettime() - start;
+}
+
+static void faust_render_compute(t_faust_render* x)
+{
+    long n;
+    size_t const size = x->f_isdbl ? sizeof(double) : sizeof(float);
+    int i, nchans = x->f_ninputs + x->f_noutputs;
+    void** ptrs = (void**)x->f_sigs + nchans;
+    if(x->f_nblocks)
+    {
+        faust_render_bench(x);
+        return;
+    }
+    for(n = 0; n < x->f_nsamples; n += x->f_blocksize)
+    {
+        int const count = x->f_nsamples - n < x->f_blocksize ? (int)(x->f_nsamples - n) : x->f_blocksize;
+        for(i = 0; i < nchans; ++i)
+        {
+            ptrs[i] = (char *)x->f_sigs[i] + n * size;
+        }
+        computeCDSPInstance(x->f_dsp, count, (FAUSTFLOAT**)ptrs, (FAUSTFLOAT**)(ptrs + x->f_ninputs));
+        if(faust_render_cancelled(x))
+        {
+            break;
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI faust_render_thread(LPVOID arg)
+{
+    faust_render_compute((t_faust_render *)arg);
+    return 0;
+}
+#else
+static void* faust_render_thread(void* arg)
+{
+    t_faust_render* x = (t_faust_render *)arg;
+    faust_render_compute(x);
+    pthread_mutex_lock(&x->f_mutex);
+    x->f_running = 0;
+    pthread_mutex_unlock(&x->f_mutex);
+    return NULL;
+}
+#endif
+
+char faust_render_busy(t_faust_render const* x)
+{
+    char running;
+    if(!x->f_threaded)
+    {
+        return 0;
+    }
+#ifdef _WIN32
+    running = WaitForSingleObject(x->f_thread, 0) != WAIT_OBJECT_0;
+#else
+    pthread_mutex_lock((pthread_mutex_t *)&x->f_mutex);
+    running = x->f_running;
+    pthread_mutex_unlock((pthread_mutex_t *)&x->f_mutex);
+#endif
+    return running;
+}
+
+// Tell the worker thread to stop early, the result is dropped.
+static void faust_render_cancel(t_faust_render* x)
+{
+    if(x->f_threaded)
+    {
+#ifdef _WIN32
+        InterlockedExchange(&x->f_cancel, 1);
+#else
+        pthread_mutex_lock(&x->f_mutex);
+        x->f_cancel = 1;
+        pthread_mutex_unlock(&x->f_mutex);
+#endif
+    }
+}
+
+static void faust_render_join(t_faust_render* x)
+{
+    if(x->f_threaded)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(x->f_thread, INFINITE);
+        CloseHandle(x->f_thread);
+#else
+        pthread_join(x->f_thread, NULL);
+        pthread_mutex_destroy(&x->f_mutex);
+#endif
+        x->f_threaded = 0;
+    }
+}
+
+// Free the buffers and the instance, once the render is finished.
+static void faust_render_release(t_faust_render* x)
+{
+    int i;
+    size_t const size = x->f_isdbl ? sizeof(double) : sizeof(float);
+    int const nchans = x->f_ninputs + x->f_noutputs;
+    if(x->f_sigs)
+    {
+        for(i = 0; i < nchans; ++i)
+        {
+            if(x->f_sigs[i])
+            {
+                freebytes(x->f_sigs[i], x->f_nsamples * size);
+            }
+        }
+        freebytes(x->f_sigs, (2 * nchans + 1) * sizeof(void *));
+        x->f_sigs = NULL;
+    }
+    if(x->f_outs)
+    {
+        freebytes(x->f_outs, x->f_nouts * sizeof(t_symbol *));
+        x->f_outs  = NULL;
+        x->f_nouts = 0;
+    }
+    if(x->f_dsp)
+    {
+        deleteCDSPInstance(x->f_dsp);
+        x->f_dsp = NULL;
+    }
+}
+
+// Output the result of a bench.
+static void faust_render_bench_finish(t_faust_render* x)
+{
+    t_atom av[3];
+    double const nsamples = (double)x->f_nblocks * x->f_blocksize;
+    double const realtime = x->f_elapsed > 0 ? nsamples / x->f_samplerate / x->f_elapsed : 0;
+    double const nspersample = x->f_elapsed * 1e9 / nsamples;
+    logpost(x->f_owner, 3, "faustgen2~: bench: %.3f ns/sample, %.1fx realtime (%ld blocks of %d samples at %d Hz)",
+            nspersample, realtime, x->f_nblocks, x->f_blocksize, x->f_samplerate);
+    SETFLOAT(av, nspersample);
+    SETFLOAT(av+1, realtime);
+    SETFLOAT(av+2, floor(realtime));
+    outlet_anything(x->f_out, x->f_sel, 3, av);
+}
+
+// Write the outputs to the arrays, in Pd's scheduler thread, and release
+// the buffers.
+static void faust_render_finish(t_faust_render* x)
+{
+    int i;
+    long j;
+    t_atom av[2];
+    if(x->f_nblocks)
+    {
+        faust_render_release(x);
+        faust_render_bench_finish(x);
+        return;
+    }
+    for(i = 0; i < x->f_nouts && i < x->f_noutputs; ++i)
+    {
+        int size;
+        t_word* vec;
+        t_garray* a = faust_render_get_array(x->f_owner, x->f_outs[i]);
+        if(!a)
+        {
+            continue;
+        }
+        if(garray_npoints(a) != x->f_nsamples)
+        {
+            garray_resize_long(a, x->f_nsamples);
+        }
+        if(!garray_getfloatwords(a, &size, &vec) || size < x->f_nsamples)
+        {
+            pd_error(x->f_owner, "faustgen2~: render: bad array %s", x->f_outs[i]->s_name);
+            continue;
+        }
+        for(j = 0; j < x->f_nsamples; ++j)
+        {
+            vec[j].w_float = x->f_isdbl ? (t_float)((double *)x->f_sigs[x->f_ninputs+i])[j] :
+                (t_float)((float *)x->f_sigs[x->f_ninputs+i])[j];
+        }
+        garray_redraw(a);
+    }
+    SETFLOAT(av, x->f_nsamples);
+    SETFLOAT(av+1, (faust_stats_gettime() - x->f_start) * 1000.0);
+    faust_render_release(x);
+    outlet_anything(x->f_out, x->f_sel, 2, av);
+}
+
+static void faust_render_poll(t_faust_render* x)
+{
+    if(faust_render_busy(x))
+    {
+        clock_delay(x->f_clock, FAUST_RENDER_POLL_TIME);
+        return;
+    }
+    faust_render_join(x);
+    faust_render_finish(x);
+}
+
+void faust_render_free(t_faust_render* x)
+{
+    faust_render_cancel(x);
+    faust_render_join(x);
+    if(x->f_clock)
+    {
+        clock_free(x->f_clock);
+    }
+    faust_render_release(x);
+    freebytes(x, sizeof(t_faust_render));
+}
+
+// Run the render right away, or on the worker thread.
+static void faust_render_start(t_faust_render* x, char threaded)
+{
+    if(threaded)
+    {
+        x->f_clock = clock_new(x, (t_method)faust_render_poll);
+#ifdef _WIN32
+        x->f_thread = CreateThread(NULL, 0, faust_render_thread, x, 0, NULL);
+        x->f_threaded = x->f_thread != NULL;
+#else
+        pthread_mutex_init(&x->f_mutex, NULL);
+        x->f_running  = 1;
+        x->f_threaded = !pthread_create(&x->f_thread, NULL, faust_render_thread, x);
+        if(!x->f_threaded)
+        {
+            pthread_mutex_destroy(&x->f_mutex);
+        }
+#endif
+    }
+    if(!x->f_threaded)
+    {
+        // no thread, just do it right here
+        faust_render_compute(x);
+        faust_render_finish(x);
+        return;
+    }
+    clock_delay(x->f_clock, FAUST_RENDER_POLL_TIME);
+}
+
+t_faust_render* faust_render_new(t_object* owner, llvm_dsp* dsp, char isdbl, long nsamples,
+                                 int nouts, t_symbol** outs, int nins, t_symbol** ins,
+                                 t_outlet* out, t_symbol* sel)
+{
+    int i;
+    long j;
+    size_t const size = isdbl ? sizeof(double) : sizeof(float);
+    int nchans;
+    t_faust_render* x = (t_faust_render *)getzbytes(sizeof(t_faust_render));
+    if(!x)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - render");
+        deleteCDSPInstance(dsp);
+        return NULL;
+    }
+    x->f_owner    = owner;
+    x->f_dsp      = dsp;
+    x->f_isdbl    = isdbl;
+    x->f_nsamples = nsamples;
+    x->f_blocksize = FAUST_RENDER_BLOCKSIZE;
+    x->f_ninputs  = getNumInputsCDSPInstance(dsp);
+    x->f_noutputs = getNumOutputsCDSPInstance(dsp);
+    x->f_out      = out;
+    x->f_sel      = sel;
+    x->f_start    = faust_stats_gettime();
+    nchans        = x->f_ninputs + x->f_noutputs;
+    if(nouts > x->f_noutputs)
+    {
+        pd_error(owner, "faustgen2~: render: %d output arrays for %d outputs, ignoring the rest", nouts, x->f_noutputs);
+        nouts = x->f_noutputs;
+    }
+    if(nins > x->f_ninputs)
+    {
+        pd_error(owner, "faustgen2~: render: %d input arrays for %d inputs, ignoring the rest", nins, x->f_ninputs);
+        nins = x->f_ninputs;
+    }
+    // the second half holds the pointers to the current block
+    x->f_sigs = (void **)getzbytes((2 * nchans + 1) * sizeof(void *));
+    x->f_outs = nouts ? (t_symbol **)getbytes(nouts * sizeof(t_symbol *)) : NULL;
+    x->f_nouts = x->f_outs ? nouts : 0;
+    if(!x->f_sigs || x->f_nouts != nouts)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - render");
+        faust_render_free(x);
+        return NULL;
+    }
+    if(nouts)
+    {
+        memcpy(x->f_outs, outs, nouts * sizeof(t_symbol *));
+    }
+    for(i = 0; i < nchans; ++i)
+    {
+        x->f_sigs[i] = getbytes(nsamples * size);
+        if(!x->f_sigs[i])
+        {
+            pd_error(owner, "faustgen2~: memory allocation failed - render");
+            faust_render_free(x);
+            return NULL;
+        }
+    }
+    for(i = 0; i < nins; ++i)
+    {
+        int n;
+        t_word* vec;
+        t_garray* a = faust_render_get_array(owner, ins[i]);
+        if(!a || !garray_getfloatwords(a, &n, &vec))
+        {
+            faust_render_free(x);
+            return NULL;
+        }
+        for(j = 0; j < nsamples && j < n; ++j)
+        {
+            if(isdbl)
+                ((double *)x->f_sigs[i])[j] = vec[j].w_float;
+            else
+                ((float *)x->f_sigs[i])[j] = (float)vec[j].w_float;
+        }
+    }
+    for(i = 0; i < nouts; ++i)
+    {
+        if(!faust_render_get_array(owner, outs[i]))
+        {
+            faust_render_free(x);
+            return NULL;
+        }
+    }
+    faust_render_start(x, nsamples * nchans > FAUST_RENDER_THREAD_SIZE);
+    return x;
+}
+
+t_faust_render* faust_render_bench_new(t_object* owner, llvm_dsp* dsp, char isdbl, int samplerate,
+                                       int blocksize, long nblocks, t_outlet* out, t_symbol* sel)
+{
+    int i, j;
+    unsigned int seed = 307;
+    size_t const size = isdbl ? sizeof(double) : sizeof(float);
+    int nchans;
+    t_faust_render* x = (t_faust_render *)getzbytes(sizeof(t_faust_render));
+    if(!x)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - bench");
+        deleteCDSPInstance(dsp);
+        return NULL;
+    }
+    x->f_owner      = owner;
+    x->f_dsp        = dsp;
+    x->f_isdbl      = isdbl;
+    x->f_samplerate = samplerate;
+    x->f_nsamples   = blocksize;
+    x->f_blocksize  = blocksize;
+    x->f_nblocks    = nblocks;
+    x->f_ninputs    = getNumInputsCDSPInstance(dsp);
+    x->f_noutputs   = getNumOutputsCDSPInstance(dsp);
+    x->f_out        = out;
+    x->f_sel        = sel;
+    x->f_start      = faust_stats_gettime();
+    nchans          = x->f_ninputs + x->f_noutputs;
+    x->f_sigs = (void **)getzbytes((2 * nchans + 1) * sizeof(void *));
+    for(i = 0; x->f_sigs && i < nchans; ++i)
+    {
+        x->f_sigs[i] = getbytes(blocksize * size);
+        if(!x->f_sigs[i])
+        {
+            break;
+        }
+    }
+    if(!x->f_sigs || i < nchans)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - bench");
+        faust_render_free(x);
+        return NULL;
+    }
+    // white noise, same generator as noise~
+    for(i = 0; i < x->f_ninputs; ++i)
+    {
+        for(j = 0; j < blocksize; ++j)
+        {
+            double const v = ((float)((int)(seed & 0x7fffffff) - 0x40000000)) * (float)(1.0 / 0x40000000);
+            seed = seed * 435898247 + 382842987;
+            if(isdbl)
+                ((double *)x->f_sigs[i])[j] = v;
+            else
+                ((float *)x->f_sigs[i])[j] = (float)v;
+        }
+    }
+    // always off the audio path
+    faust_render_start(x, 1);
+    return x;
+}
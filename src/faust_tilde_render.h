@@ -0,0 +1,47 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_RENDER_H
+#define FAUST_TILDE_RENDER_H
+
+#include <m_pd.h>
+#include <faust/dsp/llvm-c-dsp.h>
+
+// ag: Offline rendering of a dsp instance into Pd arrays. The inputs are
+// read from the given input arrays (zero-padded, missing arrays are silent),
+// the outputs are written to the output arrays, which are resized to the
+// number of samples. Short renders are done right away, longer ones run on
+// a worker thread, which only touches the render's own buffers; the arrays
+// are read when starting and written once the thread is done, both in Pd's
+// scheduler thread. On completion, the number of samples and the elapsed
+// time in msecs are output on the given outlet, with the given selector.
+// The buffers and the instance are released as soon as the render is done.
+// The same machinery runs benches of an instance off the audio path.
+
+struct _faust_render;
+typedef struct _faust_render t_faust_render;
+
+// Start a render of nsamples. The renderer takes over the dsp instance, which
+// must already be initialized, and deletes it when done. Returns NULL on
+// error, in which case the instance is deleted as well.
+t_faust_render* faust_render_new(t_object* owner, llvm_dsp* dsp, char isdbl, long nsamples,
+                                 int nouts, t_symbol** outs, int nins, t_symbol** ins,
+                                 t_outlet* out, t_symbol* sel);
+
+// Start a bench of nblocks blocks of the dsp instance on noise input, on the
+// worker thread. On completion, the time per sample in ns, the real-time
+// factor and its integer part are output. Takes over the instance like
+// faust_render_new.
+t_faust_render* faust_render_bench_new(t_object* owner, llvm_dsp* dsp, char isdbl, int samplerate,
+                                       int blocksize, long nblocks, t_outlet* out, t_symbol* sel);
+
+// Whether the worker thread is still running.
+char faust_render_busy(t_faust_render const* x);
+
+// Stops the worker thread if it's still running, the result is dropped.
+void faust_render_free(t_faust_render* x);
+
+#endif
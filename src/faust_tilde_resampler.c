@@ -0,0 +1,423 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_resampler.h"
+#include <string.h>
+#include <math.h>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+#ifdef _MSC_VER
+#define restrict __restrict
+#endif
+
+// ag: Number of filter taps per polyphase branch. The prototype lowpass has
+// factor*FAUST_RESAMPLER_TAPS taps, with a Kaiser window (beta 7.865) and its
+// cutoff (-6 dB) at 88% of the Nyquist frequency of the lower rate. Its
+// passband is flat within 0.1 dB up to 80% of the Nyquist frequency (about
+// 19 kHz at 48 kHz), and it attenuates by at least 80 dB from the Nyquist
+// frequency on. The combined latency of interpolator and decimator then works
+// out to FAUST_RESAMPLER_TAPS-1 = 47 samples at the lower rate.
+#define FAUST_RESAMPLER_TAPS 48
+#define FAUST_RESAMPLER_BETA 7.865
+#define FAUST_RESAMPLER_CUTOFF 0.88
+
+typedef struct _faust_resampler
+{
+    t_object*   f_owner;
+    int         f_factor;
+    char        f_decimate;
+    size_t      f_ninputs;
+    size_t      f_noutputs;
+    size_t      f_nbuffers;
+    size_t      f_nsamples;
+    char        f_isdbl;
+    size_t      f_size;
+
+    // polyphase coefficients, factor branches of FAUST_RESAMPLER_TAPS each,
+    // stored in reverse order so that the filter loops run forward
+    void*       f_upcoefs;
+    void*       f_downcoefs;
+
+    // filter histories: FAUST_RESAMPLER_TAPS-1 samples of the previous
+    // block followed by the current block (at the lower of the two rates);
+    // one per interpolator, factor (one per branch) per decimator
+    size_t      f_nup;
+    size_t      f_ndown;
+    size_t      f_lowlen;
+    size_t      f_buflen;
+    size_t      f_histlen;
+    void*       f_uphist;
+    void*       f_downhist;
+    void*       f_temp;
+
+    void**      f_signals;
+    void*       f_aligned;
+}t_faust_resampler;
+
+static double faust_resampler_bessel_i0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    int k;
+    for(k = 1; k < 50; ++k)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum  += term;
+        if(term < sum * 1e-12)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc lowpass with unity DC gain
+static void faust_resampler_design(double* h, int factor)
+{
+    int const ntaps = factor * FAUST_RESAMPLER_TAPS;
+    double const fc = FAUST_RESAMPLER_CUTOFF * 0.5 / (double)factor;
+    double const center = (ntaps - 1) * 0.5;
+    double const norm = faust_resampler_bessel_i0(FAUST_RESAMPLER_BETA);
+    double sum = 0.0;
+    int j;
+    for(j = 0; j < ntaps; ++j)
+    {
+        double const t = j - center;
+        double const r = 2.0 * j / (ntaps - 1) - 1.0;
+        double const w = faust_resampler_bessel_i0(FAUST_RESAMPLER_BETA * sqrt(1.0 - r * r)) / norm;
+        double const s = t == 0.0 ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+        h[j] = s * w;
+        sum += h[j];
+    }
+    for(j = 0; j < ntaps; ++j)
+    {
+        h[j] /= sum;
+    }
+}
+
+static void faust_resampler_set_coef(t_faust_resampler* x, void* coefs, int i, double value)
+{
+    if(x->f_isdbl)
+    {
+        ((double*)coefs)[i] = value;
+    }
+    else
+    {
+        ((float*)coefs)[i] = (float)value;
+    }
+}
+
+t_faust_resampler* faust_resampler_new(t_object* owner, int factor, char decimate, size_t ninputs, size_t noutputs,
+                                       size_t nbuffers, size_t nsamples, char isdbl)
+{
+    size_t i;
+    int p, k;
+    int const L = FAUST_RESAMPLER_TAPS;
+    double* h;
+    t_faust_resampler* x = (t_faust_resampler*)getzbytes(sizeof(t_faust_resampler));
+    if(!x)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - resampler");
+        return NULL;
+    }
+    x->f_owner      = owner;
+    x->f_factor     = factor;
+    x->f_decimate   = decimate;
+    x->f_ninputs    = ninputs;
+    x->f_noutputs   = noutputs;
+    x->f_nbuffers   = nbuffers;
+    x->f_nsamples   = nsamples;
+    x->f_isdbl      = isdbl;
+    x->f_size       = isdbl ? sizeof(double) : sizeof(float);
+    // oversampling interpolates the inputs and decimates the outputs,
+    // decimation does it the other way round
+    x->f_nup        = decimate ? noutputs : ninputs;
+    x->f_ndown      = decimate ? ninputs : noutputs;
+    x->f_lowlen     = decimate ? nsamples / factor : nsamples;
+    x->f_buflen     = decimate ? nsamples / factor : nsamples * factor;
+    x->f_histlen    = (size_t)(L - 1) + x->f_lowlen;
+
+    x->f_upcoefs    = getzbytes(factor * L * x->f_size);
+    x->f_downcoefs  = getzbytes(factor * L * x->f_size);
+    x->f_uphist     = getzbytes((x->f_nup ? x->f_nup : 1) * x->f_histlen * x->f_size);
+    x->f_downhist   = getzbytes((x->f_ndown ? x->f_ndown : 1) * factor * x->f_histlen * x->f_size);
+    x->f_temp       = getzbytes((x->f_lowlen + 1) * x->f_size);
+    x->f_signals    = (void**)getzbytes((ninputs + nbuffers + 1) * sizeof(void*));
+    x->f_aligned    = getzbytes(((ninputs + nbuffers) * x->f_buflen + 1) * x->f_size);
+    h               = (double*)getbytes(factor * L * sizeof(double));
+    if(!x->f_upcoefs || !x->f_downcoefs || !x->f_uphist || !x->f_downhist ||
+       !x->f_temp || !x->f_signals || !x->f_aligned || !h)
+    {
+        pd_error(owner, "faustgen2~: memory allocation failed - resampler");
+        if(h)
+        {
+            freebytes(h, factor * L * sizeof(double));
+        }
+        faust_resampler_free(x);
+        return NULL;
+    }
+    for(i = 0; i < ninputs + nbuffers; ++i)
+    {
+        x->f_signals[i] = (char*)x->f_aligned + i * x->f_buflen * x->f_size;
+    }
+
+    // Interpolator branch p yields the output samples n*factor+p, decimator
+    // branch p takes the input samples n*factor+p. The
+    // interpolator gain compensates for the zero stuffing.
+    faust_resampler_design(h, factor);
+    for(p = 0; p < factor; ++p)
+    {
+        for(k = 0; k < L; ++k)
+        {
+            faust_resampler_set_coef(x, x->f_upcoefs, p * L + k, factor * h[(L - 1 - k) * factor + p]);
+            faust_resampler_set_coef(x, x->f_downcoefs, p * L + k, h[(L - 1 - k) * factor + factor - 1 - p]);
+        }
+    }
+    freebytes(h, factor * L * sizeof(double));
+    return x;
+}
+
+void faust_resampler_free(t_faust_resampler* x)
+{
+    if(x)
+    {
+        size_t const factor = (size_t)x->f_factor;
+        size_t const L = FAUST_RESAMPLER_TAPS;
+        if(x->f_upcoefs)
+        {
+            freebytes(x->f_upcoefs, factor * L * x->f_size);
+        }
+        if(x->f_downcoefs)
+        {
+            freebytes(x->f_downcoefs, factor * L * x->f_size);
+        }
+        if(x->f_uphist)
+        {
+            freebytes(x->f_uphist, (x->f_nup ? x->f_nup : 1) * x->f_histlen * x->f_size);
+        }
+        if(x->f_downhist)
+        {
+            freebytes(x->f_downhist, (x->f_ndown ? x->f_ndown : 1) * factor * x->f_histlen * x->f_size);
+        }
+        if(x->f_temp)
+        {
+            freebytes(x->f_temp, (x->f_lowlen + 1) * x->f_size);
+        }
+        if(x->f_signals)
+        {
+            freebytes(x->f_signals, (x->f_ninputs + x->f_nbuffers + 1) * sizeof(void*));
+        }
+        if(x->f_aligned)
+        {
+            freebytes(x->f_aligned, ((x->f_ninputs + x->f_nbuffers) * x->f_buflen + 1) * x->f_size);
+        }
+        freebytes(x, sizeof(t_faust_resampler));
+    }
+}
+
+size_t faust_resampler_get_memory(t_faust_resampler const* x)
+{
+    size_t size = 0;
+    if(x)
+    {
+        size_t const factor = (size_t)x->f_factor;
+        size_t const L = FAUST_RESAMPLER_TAPS;
+        size  = sizeof(t_faust_resampler);
+        size += (x->f_upcoefs ? factor * L * x->f_size : 0) + (x->f_downcoefs ? factor * L * x->f_size : 0);
+        size += (x->f_nup ? x->f_nup : 1) * x->f_histlen * x->f_size;
+        size += (x->f_ndown ? x->f_ndown : 1) * factor * x->f_histlen * x->f_size;
+        size += (x->f_lowlen + 1) * x->f_size;
+        size += (x->f_ninputs + x->f_nbuffers + 1) * sizeof(void*);
+        size += ((x->f_ninputs + x->f_nbuffers) * x->f_buflen + 1) * x->f_size;
+    }
+    return size;
+}
+
+void** faust_resampler_get_signals(t_faust_resampler* x)
+{
+    return x->f_signals;
+}
+
+int faust_resampler_get_latency(int factor, char decimate)
+{
+    if(factor < 2)
+    {
+        return 0;
+    }
+    return decimate ? factor * (FAUST_RESAMPLER_TAPS - 1) : FAUST_RESAMPLER_TAPS - 1;
+}
+
+// The filter kernels: out[n] (+)= sum(coefs[k]*hist[n+k], k = 0..TAPS-1).
+// The loops run over the samples in the inner loop, which lets the compiler
+// vectorize them without having to reorder any floating point sums.
+static void faust_resampler_fir_single(float* restrict out, float const* restrict coefs,
+                                       float const* restrict hist, int nsamples, char accumulate)
+{
+    int k, n;
+    if(!accumulate)
+    {
+        float const c = coefs[0];
+        for(n = 0; n < nsamples; ++n)
+        {
+            out[n] = c * hist[n];
+        }
+    }
+    for(k = accumulate ? 0 : 1; k < FAUST_RESAMPLER_TAPS; ++k)
+    {
+        float const c = coefs[k];
+        float const* in = hist + k;
+        for(n = 0; n < nsamples; ++n)
+        {
+            out[n] += c * in[n];
+        }
+    }
+}
+
+static void faust_resampler_fir_double(double* restrict out, double const* restrict coefs,
+                                       double const* restrict hist, int nsamples, char accumulate)
+{
+    int k, n;
+    if(!accumulate)
+    {
+        double const c = coefs[0];
+        for(n = 0; n < nsamples; ++n)
+        {
+            out[n] = c * hist[n];
+        }
+    }
+    for(k = accumulate ? 0 : 1; k < FAUST_RESAMPLER_TAPS; ++k)
+    {
+        double const c = coefs[k];
+        double const* in = hist + k;
+        for(n = 0; n < nsamples; ++n)
+        {
+            out[n] += c * in[n];
+        }
+    }
+}
+
+static void faust_resampler_fir(t_faust_resampler* x, void* out, void const* coefs, void const* hist,
+                                int nsamples, char accumulate)
+{
+    if(x->f_isdbl)
+    {
+        faust_resampler_fir_double((double*)out, (double const*)coefs, (double const*)hist, nsamples, accumulate);
+    }
+    else
+    {
+        faust_resampler_fir_single((float*)out, (float const*)coefs, (float const*)hist, nsamples, accumulate);
+    }
+}
+
+// Keep the last TAPS-1 samples of the history for the next block.
+static void faust_resampler_shift(t_faust_resampler* x, char* hist, int nsamples)
+{
+    memmove(hist, hist + nsamples * x->f_size, (FAUST_RESAMPLER_TAPS - 1) * x->f_size);
+}
+
+// Interpolate nsamples of in into factor*nsamples of out.
+static void faust_resampler_interpolate(t_faust_resampler* x, size_t chan, void const* in, void* out, int nsamples)
+{
+    int p, n;
+    int const factor = x->f_factor;
+    size_t const L = FAUST_RESAMPLER_TAPS;
+    char* hist = (char*)x->f_uphist + chan * x->f_histlen * x->f_size;
+    memcpy(hist + (L - 1) * x->f_size, in, nsamples * x->f_size);
+    for(p = 0; p < factor; ++p)
+    {
+        faust_resampler_fir(x, x->f_temp, (char*)x->f_upcoefs + p * L * x->f_size, hist, nsamples, 0);
+        if(x->f_isdbl)
+        {
+            double* branch = (double*)out + p;
+            double const* temp = (double const*)x->f_temp;
+            for(n = 0; n < nsamples; ++n)
+            {
+                branch[n * factor] = temp[n];
+            }
+        }
+        else
+        {
+            float* branch = (float*)out + p;
+            float const* temp = (float const*)x->f_temp;
+            for(n = 0; n < nsamples; ++n)
+            {
+                branch[n * factor] = temp[n];
+            }
+        }
+    }
+    faust_resampler_shift(x, hist, nsamples);
+}
+
+// Decimate factor*nsamples of in into nsamples of out.
+static void faust_resampler_decimate(t_faust_resampler* x, size_t chan, void const* in, void* out, int nsamples)
+{
+    int p, n;
+    int const factor = x->f_factor;
+    size_t const L = FAUST_RESAMPLER_TAPS;
+    for(p = 0; p < factor; ++p)
+    {
+        char* hist = (char*)x->f_downhist + (chan * factor + p) * x->f_histlen * x->f_size;
+        // split the signal into the polyphase branches
+        if(x->f_isdbl)
+        {
+            double* branch = (double*)hist + (L - 1);
+            double const* src = (double const*)in + p;
+            for(n = 0; n < nsamples; ++n)
+            {
+                branch[n] = src[n * factor];
+            }
+        }
+        else
+        {
+            float* branch = (float*)hist + (L - 1);
+            float const* src = (float const*)in + p;
+            for(n = 0; n < nsamples; ++n)
+            {
+                branch[n] = src[n * factor];
+            }
+        }
+        faust_resampler_fir(x, out, (char*)x->f_downcoefs + p * L * x->f_size, hist, nsamples, p > 0);
+        faust_resampler_shift(x, hist, nsamples);
+    }
+}
+
+int faust_resampler_get_nsamples(t_faust_resampler const* x, int nsamples)
+{
+    return x->f_decimate ? nsamples / x->f_factor : nsamples * x->f_factor;
+}
+
+void faust_resampler_process_inputs(t_faust_resampler* x, void** ins, size_t nchans, int nsamples)
+{
+    size_t i;
+    for(i = 0; i < nchans && i < x->f_ninputs; ++i)
+    {
+        if(x->f_decimate)
+        {
+            faust_resampler_decimate(x, i, ins[i], x->f_signals[i], nsamples / x->f_factor);
+        }
+        else
+        {
+            faust_resampler_interpolate(x, i, ins[i], x->f_signals[i], nsamples);
+        }
+    }
+}
+
+void faust_resampler_process_outputs(t_faust_resampler* x, size_t chan, void** outs, size_t nchans, int nsamples)
+{
+    size_t i;
+    for(i = 0; i < nchans && chan + i < x->f_noutputs; ++i)
+    {
+        if(x->f_decimate)
+        {
+            faust_resampler_interpolate(x, chan + i, x->f_signals[x->f_ninputs + i], outs[i], nsamples / x->f_factor);
+        }
+        else
+        {
+            faust_resampler_decimate(x, chan + i, x->f_signals[x->f_ninputs + i], outs[i], nsamples);
+        }
+    }
+}
@@ -0,0 +1,51 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_RESAMPLER_H
+#define FAUST_TILDE_RESAMPLER_H
+
+#include <m_pd.h>
+
+// ag: Polyphase FIR resamplers for the oversampling and decimation modes.
+// The resampler owns the signal buffers at the dsp's rate (ninputs input
+// buffers, followed by nbuffers output and scratch buffers) and keeps the
+// filter state of all inputs and outputs. With oversampling, the inputs
+// are interpolated and the outputs decimated; with decimation (decimate
+// flag), it's the other way round. nsamples is the block size at Pd's rate,
+// which must be a multiple of the factor when decimating. The samples are
+// float or double, depending on isdbl.
+
+#define FAUST_RESAMPLER_MAXFACTOR 16
+
+struct _faust_resampler;
+typedef struct _faust_resampler t_faust_resampler;
+
+t_faust_resampler* faust_resampler_new(t_object* owner, int factor, char decimate, size_t ninputs, size_t noutputs,
+                                       size_t nbuffers, size_t nsamples, char isdbl);
+
+void faust_resampler_free(t_faust_resampler* x);
+
+void** faust_resampler_get_signals(t_faust_resampler* x);
+
+// Memory used by the buffers and filters in bytes, 0 for a NULL resampler.
+size_t faust_resampler_get_memory(t_faust_resampler const* x);
+
+// Number of samples at the dsp's rate for nsamples at Pd's rate.
+int faust_resampler_get_nsamples(t_faust_resampler const* x, int nsamples);
+
+// Latency of the interpolator and decimator combined, in samples at Pd's
+// sample rate.
+int faust_resampler_get_latency(int factor, char decimate);
+
+// Resample nsamples of each of the given nchans input signals into the
+// input buffers.
+void faust_resampler_process_inputs(t_faust_resampler* x, void** ins, size_t nchans, int nsamples);
+
+// Resample the first nchans output buffers into nsamples of outs, using the
+// filters of the outputs chan, ..., chan+nchans-1.
+void faust_resampler_process_outputs(t_faust_resampler* x, size_t chan, void** outs, size_t nchans, int nsamples);
+
+#endif
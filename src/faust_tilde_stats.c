@@ -0,0 +1,435 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_stats.h"
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#else
+#include <time.h>
+#endif
+
+// The histogram covers values from FAUST_STATS_MIN up to FAUST_STATS_MIN *
+// 2^(FAUST_STATS_NBINS/FAUST_STATS_BINS_PER_OCTAVE), values outside that
+// range go into the first and last bin, respectively.
+#define FAUST_STATS_NBINS 128
+#define FAUST_STATS_BINS_PER_OCTAVE 4
+#define FAUST_STATS_MIN 1e-6
+
+typedef struct _faust_stats
+{
+    size_t      f_count;
+    double      f_sum;
+    double      f_max;
+    size_t      f_bins[FAUST_STATS_NBINS];
+}t_faust_stats;
+
+double faust_stats_gettime(void)
+{
+#ifdef _WIN32
+    static double period = 0.0;
+    LARGE_INTEGER count;
+    if(period == 0.0)
+    {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        period = 1.0 / (double)freq.QuadPart;
+    }
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart * period;
+#elif defined(__APPLE__)
+    static double period = 0.0;
+    if(period == 0.0)
+    {
+        mach_timebase_info_data_t info;
+        mach_timebase_info(&info);
+        period = 1e-9 * (double)info.numer / (double)info.denom;
+    }
+    return (double)mach_absolute_time() * period;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+#endif
+}
+
+t_faust_stats* faust_stats_new(void)
+{
+    t_faust_stats* x = (t_faust_stats*)getzbytes(sizeof(t_faust_stats));
+    return x;
+}
+
+void faust_stats_free(t_faust_stats* x)
+{
+    if(x)
+    {
+        freebytes(x, sizeof(t_faust_stats));
+    }
+}
+
+void faust_stats_reset(t_faust_stats* x)
+{
+    memset(x, 0, sizeof(t_faust_stats));
+}
+
+void faust_stats_add(t_faust_stats* x, double value)
+{
+    int bin = 0;
+    if(value > FAUST_STATS_MIN)
+    {
+        bin = (int)(FAUST_STATS_BINS_PER_OCTAVE * log2(value / FAUST_STATS_MIN));
+        if(bin >= FAUST_STATS_NBINS)
+        {
+            bin = FAUST_STATS_NBINS - 1;
+        }
+    }
+    x->f_bins[bin]++;
+    x->f_count++;
+    x->f_sum += value;
+    if(value > x->f_max)
+    {
+        x->f_max = value;
+    }
+}
+
+size_t faust_stats_get_count(t_faust_stats const* x)
+{
+    return x->f_count;
+}
+
+double faust_stats_get_mean(t_faust_stats const* x)
+{
+    return x->f_count ? x->f_sum / (double)x->f_count : 0.0;
+}
+
+double faust_stats_get_max(t_faust_stats const* x)
+{
+    return x->f_max;
+}
+
+double faust_stats_get_percentile(t_faust_stats const* x, double p)
+{
+    size_t i, sum = 0;
+    size_t const rank = (size_t)ceil(p * (double)x->f_count);
+    if(!x->f_count)
+    {
+        return 0.0;
+    }
+    for(i = 0; i < FAUST_STATS_NBINS; ++i)
+    {
+        sum += x->f_bins[i];
+        if(sum >= rank && sum > 0)
+        {
+            // geometric center of the bin, but never beyond the maximum
+            double const value = FAUST_STATS_MIN * exp2((i + 0.5) / FAUST_STATS_BINS_PER_OCTAVE);
+            return value < x->f_max ? value : x->f_max;
+        }
+    }
+    return x->f_max;
+}
+
+typedef struct _faust_stats_entry
+{
+    t_symbol*                   f_name;
+    int                         f_ninstances;
+    long                        f_ncompiles;
+    double                      f_compile_time;
+    long                        f_ncachehits;
+    long                        f_memory;
+    double                      f_time;
+    struct _faust_stats_entry*  f_next;
+}t_faust_stats_entry;
+
+static t_faust_stats_entry* faust_stats_registry_entries = NULL;
+static char                 faust_stats_registry_on      = 0;
+static t_clock*             faust_stats_registry_clock   = NULL;
+static t_symbol*            faust_stats_registry_receiver = NULL;
+static char                 faust_stats_registry_print   = 0;
+
+t_faust_stats_entry* faust_stats_registry_get(t_symbol* name)
+{
+    t_faust_stats_entry* e;
+    for(e = faust_stats_registry_entries; e; e = e->f_next)
+    {
+        if(e->f_name == name)
+        {
+            return e;
+        }
+    }
+    e = (t_faust_stats_entry*)getzbytes(sizeof(t_faust_stats_entry));
+    if(e)
+    {
+        // ag: keep the entries sorted by name, for the output
+        t_faust_stats_entry** prev = &faust_stats_registry_entries;
+        while(*prev && strcmp((*prev)->f_name->s_name, name->s_name) < 0)
+        {
+            prev = &(*prev)->f_next;
+        }
+        e->f_name = name;
+        e->f_next = *prev;
+        *prev = e;
+    }
+    return e;
+}
+
+void faust_stats_registry_instances(t_faust_stats_entry* e, int delta)
+{
+    if(e)
+    {
+        e->f_ninstances += delta;
+    }
+}
+
+void faust_stats_registry_compile(t_faust_stats_entry* e, double time, char cachehit)
+{
+    if(e)
+    {
+        e->f_ncompiles++;
+        e->f_compile_time += time;
+        e->f_ncachehits += cachehit != 0;
+    }
+}
+
+void faust_stats_registry_memory(t_faust_stats_entry* e, long delta)
+{
+    if(e)
+    {
+        e->f_memory += delta;
+    }
+}
+
+void faust_stats_registry_time(t_faust_stats_entry* e, double time)
+{
+    if(e)
+    {
+        e->f_time += time;
+    }
+}
+
+void faust_stats_registry_enable(char on)
+{
+    faust_stats_registry_on = on;
+}
+
+char faust_stats_registry_enabled(void)
+{
+    return faust_stats_registry_on;
+}
+
+void faust_stats_registry_reset(void)
+{
+    t_faust_stats_entry* e;
+    for(e = faust_stats_registry_entries; e; e = e->f_next)
+    {
+        e->f_ncompiles    = 0;
+        e->f_compile_time = 0;
+        e->f_ncachehits   = 0;
+        e->f_time         = 0;
+    }
+}
+
+static void faust_stats_registry_send(t_symbol* receiver, t_faust_stats_entry const* e)
+{
+    if(faust_stats_registry_print)
+    {
+        post("%s %d %ld %g %ld %ld %g", e->f_name->s_name, e->f_ninstances,
+             e->f_ncompiles, e->f_compile_time * 1000.0, e->f_ncachehits,
+             e->f_memory, e->f_time * 1000.0);
+    }
+    if(receiver && receiver->s_thing)
+    {
+        t_atom av[6];
+        SETFLOAT(av,   e->f_ninstances);
+        SETFLOAT(av+1, e->f_ncompiles);
+        SETFLOAT(av+2, e->f_compile_time * 1000.0);
+        SETFLOAT(av+3, e->f_ncachehits);
+        SETFLOAT(av+4, e->f_memory);
+        SETFLOAT(av+5, e->f_time * 1000.0);
+        pd_typedmess(receiver->s_thing, e->f_name, 6, av);
+    }
+}
+
+static void faust_stats_registry_output(void* dummy)
+{
+    t_faust_stats_entry* e;
+    t_faust_stats_entry total;
+    t_symbol* receiver = faust_stats_registry_receiver;
+    if(faust_stats_registry_print)
+    {
+        post("faustgen2~ stats: dsp instances compiles compile-time(ms) cache-hits memory(bytes) compute-time(ms)");
+    }
+    memset(&total, 0, sizeof(total));
+    total.f_name = gensym("total");
+    for(e = faust_stats_registry_entries; e; e = e->f_next)
+    {
+        faust_stats_registry_send(receiver, e);
+        total.f_ninstances    += e->f_ninstances;
+        total.f_ncompiles     += e->f_ncompiles;
+        total.f_compile_time  += e->f_compile_time;
+        total.f_ncachehits    += e->f_ncachehits;
+        total.f_memory        += e->f_memory;
+        total.f_time          += e->f_time;
+    }
+    faust_stats_registry_send(receiver, &total);
+    faust_stats_registry_receiver = NULL;
+    faust_stats_registry_print    = 0;
+}
+
+void faust_stats_registry_query(t_symbol* receiver)
+{
+    if(!faust_stats_registry_clock)
+    {
+        faust_stats_registry_clock = clock_new(NULL, (t_method)faust_stats_registry_output);
+    }
+    if(receiver)
+    {
+        faust_stats_registry_receiver = receiver;
+    }
+    else
+    {
+        faust_stats_registry_print = 1;
+    }
+    clock_delay(faust_stats_registry_clock, 0);
+}
+
+#define FAUST_STATS_PROFILE_MAXSTAGES 16
+
+typedef struct _faust_stats_profile
+{
+    t_symbol*   p_name;
+    t_symbol*   p_source;
+    int         p_nstages;
+    char const* p_stages[FAUST_STATS_PROFILE_MAXSTAGES];
+    double      p_times[FAUST_STATS_PROFILE_MAXSTAGES];
+    double      p_total;
+}t_faust_stats_profile;
+
+static char                     faust_stats_profile_on       = 0;
+static t_faust_stats_profile*   faust_stats_profile_records  = NULL;
+static size_t                   faust_stats_profile_size     = 0;
+static size_t                   faust_stats_profile_count    = 0;
+static t_clock*                 faust_stats_profile_clock    = NULL;
+
+void faust_stats_profile_enable(char on)
+{
+    faust_stats_profile_on = on;
+}
+
+char faust_stats_profile_enabled(void)
+{
+    return faust_stats_profile_on;
+}
+
+static int faust_stats_profile_compare(void const* a, void const* b)
+{
+    double const ta = ((t_faust_stats_profile const*)a)->p_total;
+    double const tb = ((t_faust_stats_profile const*)b)->p_total;
+    return ta < tb ? 1 : ta > tb ? -1 : 0;
+}
+
+static void faust_stats_profile_output(void* dummy)
+{
+    size_t i, j;
+    double total = 0;
+    char buf[MAXPDSTRING];
+    t_faust_stats_profile* records = faust_stats_profile_records;
+    qsort(records, faust_stats_profile_count, sizeof(t_faust_stats_profile), faust_stats_profile_compare);
+    for(i = 0; i < faust_stats_profile_count; ++i)
+    {
+        total += records[i].p_total;
+    }
+    post("faustgen2~ load profile: %lu objects in %g msec",
+         (unsigned long)faust_stats_profile_count, total * 1000.0);
+    for(i = 0; i < faust_stats_profile_count; ++i)
+    {
+        int k, n = 0;
+        for(k = 0; k < records[i].p_nstages && n < MAXPDSTRING; ++k)
+        {
+            n += snprintf(buf + n, MAXPDSTRING - n, "%s%s %g", k ? ", " : "",
+                          records[i].p_stages[k], records[i].p_times[k] * 1000.0);
+        }
+        post("%s: %g msec (%s)", records[i].p_name->s_name, records[i].p_total * 1000.0,
+             n ? buf : "");
+    }
+    // ag: duplicate compiles of the same source with the same options
+    for(i = 0; i < faust_stats_profile_count; ++i)
+    {
+        size_t count = 1;
+        double time = records[i].p_total;
+        for(j = 0; j < i && records[j].p_source != records[i].p_source; ++j)
+        {
+        }
+        if(j < i)
+        {
+            // already reported
+            continue;
+        }
+        for(j = i + 1; j < faust_stats_profile_count; ++j)
+        {
+            if(records[j].p_source == records[i].p_source)
+            {
+                count++;
+                time += records[j].p_total;
+            }
+        }
+        if(count > 1)
+        {
+            post("warning: %s compiled %lu times (%g msec in total)",
+                 records[i].p_source->s_name, (unsigned long)count, time * 1000.0);
+        }
+    }
+    freebytes(faust_stats_profile_records, faust_stats_profile_size * sizeof(t_faust_stats_profile));
+    faust_stats_profile_records = NULL;
+    faust_stats_profile_size    = 0;
+    faust_stats_profile_count   = 0;
+}
+
+void faust_stats_profile_add(t_symbol* name, t_symbol* source, int nstages,
+                             char const** stages, double const* times)
+{
+    int i;
+    t_faust_stats_profile* record;
+    if(!faust_stats_profile_on)
+    {
+        return;
+    }
+    if(faust_stats_profile_count == faust_stats_profile_size)
+    {
+        size_t const size = faust_stats_profile_size ? 2 * faust_stats_profile_size : 64;
+        t_faust_stats_profile* records = (t_faust_stats_profile*)resizebytes(faust_stats_profile_records,
+            faust_stats_profile_size * sizeof(t_faust_stats_profile), size * sizeof(t_faust_stats_profile));
+        if(!records)
+        {
+            pd_error(NULL, "faustgen2~: memory allocation failed - load profile");
+            return;
+        }
+        faust_stats_profile_records = records;
+        faust_stats_profile_size    = size;
+    }
+    record = faust_stats_profile_records + faust_stats_profile_count++;
+    record->p_name    = name;
+    record->p_source  = source;
+    record->p_nstages = nstages < FAUST_STATS_PROFILE_MAXSTAGES ? nstages : FAUST_STATS_PROFILE_MAXSTAGES;
+    record->p_total   = 0;
+    for(i = 0; i < record->p_nstages; ++i)
+    {
+        record->p_stages[i] = stages[i];
+        record->p_times[i]  = times[i];
+        record->p_total    += times[i];
+    }
+    // the summary is printed when the patch is done loading
+    if(!faust_stats_profile_clock)
+    {
+        faust_stats_profile_clock = clock_new(NULL, (t_method)faust_stats_profile_output);
+    }
+    clock_delay(faust_stats_profile_clock, 0);
+}
@@ -0,0 +1,88 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_STATS_H
+#define FAUST_TILDE_STATS_H
+
+#include <m_pd.h>
+
+// ag: Timing statistics for the dsp load meter. Values are collected in a
+// log-scale histogram (4 bins per octave), which gives the percentiles with
+// an error of less than 10% at a fixed cost per value.
+
+struct _faust_stats;
+typedef struct _faust_stats t_faust_stats;
+
+// Monotonic clock in seconds, for measuring time intervals.
+double faust_stats_gettime(void);
+
+t_faust_stats* faust_stats_new(void);
+
+void faust_stats_free(t_faust_stats* x);
+
+void faust_stats_reset(t_faust_stats* x);
+
+void faust_stats_add(t_faust_stats* x, double value);
+
+size_t faust_stats_get_count(t_faust_stats const* x);
+
+double faust_stats_get_mean(t_faust_stats const* x);
+
+double faust_stats_get_max(t_faust_stats const* x);
+
+// p is a fraction between 0 and 1, e.g., 0.99 for the 99th percentile.
+double faust_stats_get_percentile(t_faust_stats const* x, double p);
+
+// ag: Process-wide registry with an entry for each dsp name, which keeps
+// track of the number of instances, compiles and their total time, factory
+// cache hits, the memory footprint of the instances and the accumulated
+// compute time. Entries are never deleted, so the objects can keep pointers
+// to their entry.
+
+struct _faust_stats_entry;
+typedef struct _faust_stats_entry t_faust_stats_entry;
+
+// Look up the entry for a dsp name, creating it if needed.
+t_faust_stats_entry* faust_stats_registry_get(t_symbol* name);
+
+void faust_stats_registry_instances(t_faust_stats_entry* e, int delta);
+
+void faust_stats_registry_compile(t_faust_stats_entry* e, double time, char cachehit);
+
+void faust_stats_registry_memory(t_faust_stats_entry* e, long delta);
+
+void faust_stats_registry_time(t_faust_stats_entry* e, double time);
+
+// Collecting the compute times is off by default.
+void faust_stats_registry_enable(char on);
+
+char faust_stats_registry_enabled(void);
+
+// Clear the compile and timing statistics. Instance counts and memory are
+// current values and are kept.
+void faust_stats_registry_reset(void);
+
+// Send the statistics of each dsp to the given receiver, using the dsp name
+// as selector, followed by the sums over all dsps with the 'total' selector,
+// or print them if receiver is NULL. Queries are deferred until
+// the current message is done, so that a query sent to all objects through
+// the global receiver is only answered once.
+void faust_stats_registry_query(t_symbol* receiver);
+
+// ag: Patch-load profiling. While enabled, each object records the duration
+// of the stages of its creation, given as nstages times (in secs) with the
+// corresponding stage names. source identifies the dsp source and compile
+// options, for flagging duplicate compiles. The summary, sorted by total
+// time, is printed once the current patch is done loading, after which the
+// records are cleared.
+void faust_stats_profile_enable(char on);
+
+char faust_stats_profile_enabled(void);
+
+void faust_stats_profile_add(t_symbol* name, t_symbol* source, int nstages,
+                             char const** stages, double const* times);
+
+#endif
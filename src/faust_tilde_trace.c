@@ -0,0 +1,159 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#include "faust_tilde_trace.h"
+#include "faust_tilde_stats.h"
+#include <stdio.h>
+
+// Number of events in the ring buffer, must be a power of 2.
+#define FAUST_TRACE_SIZE 65536
+
+typedef struct _faust_trace_event
+{
+    char const* e_name;
+    char const* e_cat;
+    t_symbol*   e_dsp;
+    double      e_start;
+    double      e_duration;
+}t_faust_trace_event;
+
+// The events are written by Pd's scheduler thread only (compiles run in the
+// message handlers, perform routines in the dsp tick), so the ring buffer
+// needs no locking; the write index just keeps counting up and is masked.
+// The buffer is kept after tracing is turned off, so that the events can
+// still be written; it is only cleared when tracing is turned on again.
+static t_faust_trace_event* faust_trace_events = NULL;
+static char                 faust_trace_on     = 0;
+static size_t               faust_trace_index  = 0;
+static double               faust_trace_origin = 0;
+static t_clock*             faust_trace_clock  = NULL;
+static char                 faust_trace_filename[MAXPDSTRING];
+
+void faust_trace_enable(char on)
+{
+    if(on)
+    {
+        if(!faust_trace_events)
+        {
+            faust_trace_events = (t_faust_trace_event*)getbytes(FAUST_TRACE_SIZE * sizeof(t_faust_trace_event));
+            if(!faust_trace_events)
+            {
+                pd_error(NULL, "faustgen2~: memory allocation failed - trace");
+                return;
+            }
+        }
+        faust_trace_index  = 0;
+        faust_trace_origin = faust_stats_gettime();
+    }
+    faust_trace_on = on && faust_trace_events;
+}
+
+void faust_trace_free(void)
+{
+    if(faust_trace_events)
+    {
+        freebytes(faust_trace_events, FAUST_TRACE_SIZE * sizeof(t_faust_trace_event));
+        faust_trace_events = NULL;
+    }
+    faust_trace_on    = 0;
+    faust_trace_index = 0;
+}
+
+char faust_trace_enabled(void)
+{
+    return faust_trace_on;
+}
+
+double faust_trace_begin(void)
+{
+    return faust_trace_on ? faust_stats_gettime() : 0;
+}
+
+void faust_trace_end(char const* name, char const* cat, t_symbol* dsp, double start)
+{
+    if(faust_trace_on)
+    {
+        t_faust_trace_event* e = faust_trace_events + (faust_trace_index & (FAUST_TRACE_SIZE - 1));
+        e->e_name     = name;
+        e->e_cat      = cat;
+        e->e_dsp      = dsp;
+        e->e_start    = start;
+        e->e_duration = faust_stats_gettime() - start;
+        faust_trace_index++;
+    }
+}
+
+static void faust_trace_write_string(FILE* fp, char const* s)
+{
+    // escape the characters which may not appear verbatim in a JSON string
+    for(; *s; ++s)
+    {
+        if(*s == '"' || *s == '\\')
+        {
+            fprintf(fp, "\\%c", *s);
+        }
+        else if((unsigned char)*s < 0x20)
+        {
+            fprintf(fp, "\\u%04x", (unsigned char)*s);
+        }
+        else
+        {
+            fputc(*s, fp);
+        }
+    }
+}
+
+static void faust_trace_output(void* dummy)
+{
+    size_t i, first;
+    FILE* fp;
+    if(!faust_trace_events)
+    {
+        pd_error(NULL, "faustgen2~: no trace recorded");
+        return;
+    }
+    fp = fopen(faust_trace_filename, "w");
+    if(!fp)
+    {
+        pd_error(NULL, "faustgen2~: can't write trace file %s", faust_trace_filename);
+        return;
+    }
+    first = faust_trace_index > FAUST_TRACE_SIZE ? faust_trace_index - FAUST_TRACE_SIZE : 0;
+    fprintf(fp, "{\"traceEvents\":[\n");
+    for(i = first; i < faust_trace_index; ++i)
+    {
+        t_faust_trace_event const* e = faust_trace_events + (i & (FAUST_TRACE_SIZE - 1));
+        // timestamps and durations are in microseconds
+        fprintf(fp, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1",
+                i > first ? ",\n" : "", e->e_name, e->e_cat,
+                (e->e_start - faust_trace_origin) * 1e6, e->e_duration * 1e6);
+        if(e->e_dsp)
+        {
+            fprintf(fp, ",\"args\":{\"dsp\":\"");
+            faust_trace_write_string(fp, e->e_dsp->s_name);
+            fprintf(fp, "\"}");
+        }
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    if(fclose(fp))
+    {
+        pd_error(NULL, "faustgen2~: can't write trace file %s", faust_trace_filename);
+        return;
+    }
+    logpost(NULL, 3, "faustgen2~: %lu trace events written to %s",
+            (unsigned long)(faust_trace_index - first), faust_trace_filename);
+}
+
+void faust_trace_write(char const* filename)
+{
+    if(!faust_trace_clock)
+    {
+        faust_trace_clock = clock_new(NULL, (t_method)faust_trace_output);
+    }
+    snprintf(faust_trace_filename, MAXPDSTRING, "%s", filename);
+    clock_delay(faust_trace_clock, 0);
+}
@@ -0,0 +1,40 @@
+/*
+// Copyright (c) 2018 - GRAME CNCM - CICM - ANR MUSICOLL - Pierre Guillot.
+// For information on usage and redistribution, and for a DISCLAIMER OF ALL
+// WARRANTIES, see the file, "LICENSE.txt," in this distribution.
+*/
+
+#ifndef FAUST_TILDE_TRACE_H
+#define FAUST_TILDE_TRACE_H
+
+#include <m_pd.h>
+
+// ag: Process-wide event tracing of the compile stages and the perform
+// routines. Spans are recorded into a fixed-size ring buffer, overwriting
+// the oldest events when it is full, and can be written to a file in the
+// Chrome trace-event format, to be viewed in chrome://tracing or Perfetto.
+// Tracing is off by default. The span names and categories must be string
+// literals, the dsp names are symbols, so recording a span never allocates.
+
+// Turn tracing on or off. Turning it on clears the buffer, turning it off
+// keeps the recorded events, so that they can still be written.
+void faust_trace_enable(char on);
+
+// Turn tracing off and free the buffer.
+void faust_trace_free(void);
+
+char faust_trace_enabled(void);
+
+// Start time of a span, 0 if tracing is off.
+double faust_trace_begin(void);
+
+// Record a span which started at the given time (as returned by
+// faust_trace_begin), and ends now. Does nothing if tracing is off.
+void faust_trace_end(char const* name, char const* cat, t_symbol* dsp, double start);
+
+// Write the recorded events to the given file. Like the statistics queries,
+// this is deferred until the current message is done, so that a request sent
+// to all objects through the global receiver writes the file only once.
+void faust_trace_write(char const* filename);
+
+#endif
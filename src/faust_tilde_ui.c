@@ -11,6 +11,8 @@
 #include <ctype.h>
 #include <float.h>
 #include <math.h>
+#include <limits.h>
+#include <stdint.h>
 
 #define MAXFAUSTSTRING 4096
 #define FAUST_UI_TYPE_BUTTON     0
@@ -170,6 +172,7 @@ typedef struct _faust_ui
     char                p_kept;
     size_t              p_index;
     FAUSTFLOAT          p_tempv;
+    FAUSTFLOAT          p_synced;
     int                 p_voice;
     size_t              p_nmidi;
     t_faust_midi_ui*    p_midi;
@@ -182,6 +185,11 @@ typedef struct _faust_ui
 typedef struct _faust_voice {
   int num; // current note playing, if any
   struct _faust_ui *freq_c, *gain_c, *gate_c;
+  // The zones of the voice controls. In the single-instance voice scheme
+  // these are just the zones of the controls above, in multi-instance
+  // polyphony (declare nvoices) they are the zones of the voice's instance.
+  FAUSTFLOATX *freq_z, *gain_z, *gate_z;
+  int state; // voice state (multi-instance polyphony only)
   struct _faust_voice *next_free, *next_used;
 } t_faust_voice;
 
@@ -190,12 +198,58 @@ typedef struct _faust_key {
   struct _faust_key *next;
 } t_faust_key;
 
+// Timestamped zone changes for sample-accurate timing. The offset is the
+// sample position in the next block at which the new value takes effect.
+typedef struct _faust_event {
+  FAUSTFLOATX *zone;
+  FAUSTFLOAT value;
+  int offset;
+} t_faust_event;
+
+#define EVENT_QUEUE_SIZE 512
+
+// entry of the control index (see faust_ui_manager_get below)
+typedef struct _faust_ui_entry {
+  t_symbol const *key;
+  struct _faust_ui *ui;
+} t_faust_ui_entry;
+
+// entry of the MIDI dispatch table (see faust_ui_manager_build_midimap below)
+typedef struct _faust_midi_entry {
+  struct _faust_ui *ui;
+  t_faust_midi_ui const *midi;
+} t_faust_midi_entry;
+
+// entry and slot of the OSC dispatch table (see faust_ui_manager_build_oscmap
+// below)
+typedef struct _faust_osc_entry {
+  t_symbol const *key; // address, or its prefix in the /path/N form
+  int arg;             // N in the /path/N form, -1 otherwise
+  size_t seq;          // position in list order
+  struct _faust_ui *ui;
+  t_faust_osc_ui const *osc;
+} t_faust_osc_entry;
+
+typedef struct _faust_osc_slot {
+  t_symbol const *key;
+  size_t start, end;   // range of the key's entries in the table
+} t_faust_osc_slot;
+
 typedef struct _faust_ui_manager
 {
     UIGlue      f_glue;
     t_object*   f_owner;
     t_faust_ui* f_uis;
     size_t      f_nuis;
+    t_faust_ui_entry* f_index;
+    size_t      f_nindex;
+    t_faust_midi_entry* f_midimap;
+    size_t      f_nmidimap;
+    size_t*     f_midislots;
+    t_faust_osc_entry* f_oscmap;
+    size_t      f_noscmap;
+    t_faust_osc_slot* f_oscslots;
+    size_t      f_noscslots;
     t_symbol**  f_names;
     size_t      f_nnames;
     MetaGlue    f_meta_glue;
@@ -206,6 +260,24 @@ typedef struct _faust_ui_manager
     t_faust_key *f_keys;
     t_faust_ui_proxy *f_panic_recv, *f_init_recv, *f_active_recv;
     t_float *f_tuning;
+    // multi-instance polyphony (declare nvoices) and ganged mode (gang=N):
+    // zone tables of all instances, f_nzones zones per instance, indexed by
+    // p_index
+    size_t      f_ninstances;
+    FAUSTFLOATX** f_zones;
+    size_t      f_nzones;
+    // values of the zones of instances 2..N across a re-initialization
+    FAUSTFLOAT* f_saved;
+    bool        f_effect;  // we're adding the controls of the effect
+    bool        f_changed; // control values changed, instances need syncing
+    bool        f_syncall; // sync all controls, not just the changed ones
+    bool        f_gang;    // instances are ganged rather than voices
+    size_t      f_instance; // ganged instance addressed by messages (0 = all)
+    // event queue for sample-accurate timing, f_evoffset is the offset of the
+    // message currently being processed (0 means immediate)
+    t_faust_event* f_events;
+    size_t      f_nevents, f_evhead;
+    int         f_evoffset;
 }t_faust_ui_manager;
 
 static void faust_free_voices(t_faust_ui_manager *x)
@@ -222,6 +294,78 @@ static void faust_free_voices(t_faust_ui_manager *x)
   }
 }
 
+static void faust_init_voice_lists(t_faust_ui_manager *x)
+{
+  // Initialize the free and used lists.
+  x->f_free = x->f_voices;
+  x->f_used = NULL;
+  for (int i = 0; i < x->f_nvoices; i++) {
+    if (i+1 < x->f_nvoices)
+      x->f_voices[i].next_free = x->f_voices+i+1;
+    else
+      x->f_voices[i].next_free = NULL;
+    x->f_voices[i].next_used = NULL;
+  }
+}
+
+// Zone of the given control in the given voice instance.
+static FAUSTFLOATX *faust_instance_zone(t_faust_ui_manager const *x, size_t k, t_faust_ui const *c)
+{
+  if (c && k < x->f_ninstances && c->p_index < x->f_nzones)
+    return x->f_zones[k*x->f_nzones+c->p_index];
+  else
+    return NULL;
+}
+
+static void faust_new_instance_voices(t_faust_ui_manager *x, int n_freq, int n_gain, int n_gate)
+{
+  t_faust_ui *c, *freq_c = NULL, *gain_c = NULL, *gate_c = NULL;
+  int n_voices = (int)x->f_ninstances;
+  if (n_freq > 1 || n_gain > 1 || n_gate > 1) {
+    pd_error(x->f_owner, "faustgen2~: inconsistent number of voice controls");
+    return;
+  }
+  for (c = x->f_uis; c; c = c->p_next) {
+    switch (c->p_voice) {
+    case VOICE_FREQ:
+      freq_c = c;
+      break;
+    case VOICE_GAIN:
+      gain_c = c;
+      break;
+    case VOICE_GATE:
+      gate_c = c;
+      break;
+    default:
+      break;
+    }
+  }
+  if (!gate_c) {
+    // Without a gate we can't tell when a voice is done, so all voices will
+    // be computed all the time.
+    pd_error(x->f_owner, "faustgen2~: warning: polyphonic dsp without gate control");
+  }
+  x->f_keys = NULL;
+  x->f_voices = getzbytes(n_voices*sizeof(t_faust_voice));
+  if (!x->f_voices) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - voice controls");
+    return;
+  }
+  logpost(x->f_owner, 3, "             [%d voice polyphony, %d instances]", n_voices, n_voices);
+  for (int k = 0; k < n_voices; k++) {
+    t_faust_voice *v = x->f_voices+k;
+    v->freq_c = freq_c;
+    v->gain_c = gain_c;
+    v->gate_c = gate_c;
+    v->freq_z = faust_instance_zone(x, k, freq_c);
+    v->gain_z = faust_instance_zone(x, k, gain_c);
+    v->gate_z = faust_instance_zone(x, k, gate_c);
+    v->state = gate_c ? STATE_IDLE : STATE_ACTIVE;
+  }
+  x->f_nvoices = n_voices;
+  faust_init_voice_lists(x);
+}
+
 static void faust_new_voices(t_faust_ui_manager *x)
 {
   // make sure not to leak any memory on these
@@ -246,6 +390,12 @@ static void faust_new_voices(t_faust_ui_manager *x)
     }
     c = c->p_next;
   }
+  if (x->f_ninstances && !x->f_gang) {
+    // Multi-instance polyphony. Here each instance has (at most) one set of
+    // voice controls, and we get one voice per instance.
+    faust_new_instance_voices(x, n_freq, n_gain, n_gate);
+    return;
+  }
   int n_voices = n_freq?n_freq:n_gain?n_gain:n_gate;
   if (n_voices) {
     if ((n_freq && n_freq != n_voices) ||
@@ -267,12 +417,15 @@ static void faust_new_voices(t_faust_ui_manager *x)
     while (c) {
       switch (c->p_voice) {
       case VOICE_FREQ:
+	x->f_voices[n_freq].freq_z = c->p_zone;
 	x->f_voices[n_freq++].freq_c = c;
 	break;
       case VOICE_GAIN:
+	x->f_voices[n_gain].gain_z = c->p_zone;
 	x->f_voices[n_gain++].gain_c = c;
 	break;
       case VOICE_GATE:
+	x->f_voices[n_gate].gate_z = c->p_zone;
 	x->f_voices[n_gate++].gate_c = c;
 	break;
       default:
@@ -281,17 +434,7 @@ static void faust_new_voices(t_faust_ui_manager *x)
       c = c->p_next;
     }
     x->f_nvoices = n_voices;
-    // Initialize the free and used lists.
-    x->f_free = x->f_voices;
-    x->f_used = NULL;
-    for (int i = 0; i < n_voices; i++) {
-      if (i+1 < n_voices)
-	x->f_voices[i].next_free = x->f_voices+i+1;
-      else
-	x->f_voices[i].next_free = NULL;
-      x->f_voices[i].next_used = NULL;
-    }
-    x->f_used = NULL;
+    faust_init_voice_lists(x);
   }
 }
 
@@ -305,6 +448,281 @@ static void faust_ui_free(t_faust_ui *c)
     faust_ui_receive_free(c->p_uirecv);
 }
 
+// ag: Hash index of the controls by short and long name, so that parameter
+// messages don't need to scan the whole list. The table is keyed by symbol
+// pointer and uses open addressing with linear probing; it's rebuilt after
+// each change of the ui list. If several controls share the same short
+// name, the name maps to the first of these in list order.
+
+static size_t faust_ui_hash(t_symbol const *s, size_t mask)
+{
+    // mix the higher bits of the address into the lower ones, symbols are
+    // allocated in fixed-size chunks, so the lowest bits are mostly the same
+    size_t h = (size_t)s;
+    h = ((h >> 16) ^ h) * 0x45d9f3bU;
+    h = (h >> 16) ^ h;
+    return h & mask;
+}
+
+static void faust_ui_manager_free_index(t_faust_ui_manager *x)
+{
+    if(x->f_index)
+    {
+        freebytes(x->f_index, x->f_nindex * sizeof(t_faust_ui_entry));
+    }
+    x->f_index  = NULL;
+    x->f_nindex = 0;
+}
+
+static void faust_ui_manager_index_add(t_faust_ui_manager *x, t_symbol const *name, t_faust_ui *c)
+{
+    size_t const mask = x->f_nindex - 1;
+    size_t i = faust_ui_hash(name, mask);
+    while(x->f_index[i].key)
+    {
+        if(x->f_index[i].key == name)
+        {
+            // duplicate name, keep the first one
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+    x->f_index[i].key = name;
+    x->f_index[i].ui  = c;
+}
+
+static void faust_ui_manager_build_index(t_faust_ui_manager *x)
+{
+    t_faust_ui *c;
+    size_t n = 16;
+    faust_ui_manager_free_index(x);
+    if(!x->f_uis)
+    {
+        return;
+    }
+    // two names per control, keep the load factor at 1/2 at most
+    while(n < 4 * x->f_nuis)
+    {
+        n *= 2;
+    }
+    x->f_index = (t_faust_ui_entry *)getzbytes(n * sizeof(t_faust_ui_entry));
+    if(!x->f_index)
+    {
+        pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui index");
+        return;
+    }
+    x->f_nindex = n;
+    for(c = x->f_uis; c; c = c->p_next)
+    {
+        faust_ui_manager_index_add(x, c->p_name, c);
+        faust_ui_manager_index_add(x, c->p_longname, c);
+    }
+}
+
+// ag: MIDI dispatch table. The MIDI bindings of all active controls are
+// sorted into slots by message type and, for the messages with a note or
+// controller number, by that number, so that an incoming message only has to
+// look at the bindings in its own slot. Numbers beyond 127 all share an extra
+// slot of their message type. Within each slot, the bindings are in list
+// order; channel filters (and the numbers in the extra slot) are checked
+// when dispatching.
+
+#define N_MIDI_NUMS 129
+// slots per message type: N_MIDI_NUMS for the 2-argument messages (ctrl, key,
+// keyon, keyoff, keypress), 1 for the rest
+#define N_MIDI_SLOTS (5 * N_MIDI_NUMS + N_MIDI - 5)
+
+static size_t midi_slot_base[N_MIDI];
+
+static void faust_ui_midi_init(void);
+
+static size_t midi_slot(int msg, int num)
+{
+  if (midi_argc[msg] > 1)
+    return midi_slot_base[msg] + (num >= 0 && num < N_MIDI_NUMS - 1 ? num : N_MIDI_NUMS - 1);
+  else
+    return midi_slot_base[msg];
+}
+
+static void faust_ui_manager_free_midimap(t_faust_ui_manager *x)
+{
+  if (x->f_midimap)
+    freebytes(x->f_midimap, x->f_nmidimap * sizeof(t_faust_midi_entry));
+  if (x->f_midislots)
+    freebytes(x->f_midislots, (N_MIDI_SLOTS + 1) * sizeof(size_t));
+  x->f_midimap = NULL;
+  x->f_nmidimap = 0;
+  x->f_midislots = NULL;
+}
+
+static void faust_ui_manager_build_midimap(t_faust_ui_manager *x)
+{
+  t_faust_ui *c;
+  size_t j, k, n = 0;
+  faust_ui_manager_free_midimap(x);
+  faust_ui_midi_init();
+  // passive controls don't receive MIDI
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      n += c->p_nmidi;
+  if (n == 0) return;
+  x->f_midimap = (t_faust_midi_entry*)getbytes(n * sizeof(t_faust_midi_entry));
+  x->f_midislots = (size_t*)getzbytes((N_MIDI_SLOTS + 1) * sizeof(size_t));
+  if (!x->f_midimap || !x->f_midislots) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui midi map");
+    if (x->f_midimap) freebytes(x->f_midimap, n * sizeof(t_faust_midi_entry));
+    if (x->f_midislots) freebytes(x->f_midislots, (N_MIDI_SLOTS + 1) * sizeof(size_t));
+    x->f_midimap = NULL;
+    x->f_midislots = NULL;
+    return;
+  }
+  x->f_nmidimap = n;
+  // counting sort: count the bindings per slot, turn the counts into the
+  // end offsets of the slots, then fill in the slots back to front
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      for (j = 0; j < c->p_nmidi; j++)
+        x->f_midislots[midi_slot(c->p_midi[j].msg, c->p_midi[j].num) + 1]++;
+  for (k = 1; k <= N_MIDI_SLOTS; k++)
+    x->f_midislots[k] += x->f_midislots[k-1];
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      for (j = 0; j < c->p_nmidi; j++) {
+        t_faust_midi_entry *e =
+          x->f_midimap + x->f_midislots[midi_slot(c->p_midi[j].msg, c->p_midi[j].num)]++;
+        e->ui = c;
+        e->midi = c->p_midi + j;
+      }
+  // the slots now start where the next ones started before, shift them back
+  for (k = N_MIDI_SLOTS; k > 0; k--)
+    x->f_midislots[k] = x->f_midislots[k-1];
+  x->f_midislots[0] = 0;
+}
+
+// ag: OSC dispatch table. The OSC bindings of all active controls are
+// looked up by address in a hash table, keyed by symbol pointer like the
+// control index above. Bindings of the /path/N form, which take their value
+// from the Nth argument of a multi-argument /path message, are also entered
+// under /path, with the argument index precomputed. Each address maps to a
+// range of entries sorted by argument index (plain bindings first) and list
+// order, so that a message only visits the entries it actually updates.
+
+static int cmposc(const void *p1, const void *p2)
+{
+  t_faust_osc_entry const *e1 = (t_faust_osc_entry const*)p1;
+  t_faust_osc_entry const *e2 = (t_faust_osc_entry const*)p2;
+  if (e1->key != e2->key)
+    return (uintptr_t)e1->key < (uintptr_t)e2->key ? -1 : 1;
+  if (e1->arg != e2->arg)
+    return e1->arg < e2->arg ? -1 : 1;
+  return e1->seq < e2->seq ? -1 : e1->seq > e2->seq;
+}
+
+// Split an address of the form /path/N into /path and N. Returns -1 if the
+// address isn't of this form.
+static int osc_split(t_symbol const *msg, t_symbol **prefix)
+{
+  char const *p = strrchr(msg->s_name, '/');
+  char buf[MAXFAUSTSTRING];
+  size_t l;
+  long k;
+  char *end;
+  if (!p || p == msg->s_name || !isdigit((unsigned char)p[1])) return -1;
+  k = strtol(p+1, &end, 10);
+  if (*end || k > INT_MAX) return -1;
+  l = p - msg->s_name;
+  if (l >= MAXFAUSTSTRING) return -1;
+  memcpy(buf, msg->s_name, l);
+  buf[l] = 0;
+  *prefix = gensym(buf);
+  return (int)k;
+}
+
+static void faust_ui_manager_free_oscmap(t_faust_ui_manager *x)
+{
+  if (x->f_oscmap)
+    freebytes(x->f_oscmap, x->f_noscmap * sizeof(t_faust_osc_entry));
+  if (x->f_oscslots)
+    freebytes(x->f_oscslots, x->f_noscslots * sizeof(t_faust_osc_slot));
+  x->f_oscmap = NULL;
+  x->f_noscmap = 0;
+  x->f_oscslots = NULL;
+  x->f_noscslots = 0;
+}
+
+static void faust_ui_manager_build_oscmap(t_faust_ui_manager *x)
+{
+  t_faust_ui *c;
+  size_t i, j, n = 0, nkeys = 0, nslots = 16;
+  faust_ui_manager_free_oscmap(x);
+  // passive controls don't receive OSC
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      n += c->p_nosc;
+  if (n == 0) return;
+  // at most two entries per binding
+  x->f_oscmap = (t_faust_osc_entry*)getbytes(2 * n * sizeof(t_faust_osc_entry));
+  if (!x->f_oscmap) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui osc map");
+    return;
+  }
+  x->f_noscmap = 2 * n;
+  n = 0;
+  for (c = x->f_uis; c; c = c->p_next)
+    if (c->p_type != FAUST_UI_TYPE_BARGRAPH)
+      for (j = 0; j < c->p_nosc; j++) {
+        t_symbol *prefix;
+        int k = osc_split(c->p_osc[j].msg, &prefix);
+        t_faust_osc_entry *e = x->f_oscmap + n++;
+        e->key = c->p_osc[j].msg;
+        e->arg = -1;
+        e->seq = n;
+        e->ui = c;
+        e->osc = c->p_osc + j;
+        if (k >= 0) {
+          e[1] = e[0];
+          e[1].key = prefix;
+          e[1].arg = k;
+          n++;
+        }
+      }
+  // group the entries by address
+  qsort(x->f_oscmap, n, sizeof(t_faust_osc_entry), cmposc);
+  for (i = 0; i < n; i++)
+    if (i == 0 || x->f_oscmap[i].key != x->f_oscmap[i-1].key)
+      nkeys++;
+  // keep the load factor at 1/2 at most
+  while (nslots < 2 * nkeys)
+    nslots *= 2;
+  x->f_oscslots = (t_faust_osc_slot*)getzbytes(nslots * sizeof(t_faust_osc_slot));
+  if (!x->f_oscslots) {
+    pd_error(x->f_owner, "faustgen2~: memory allocation failed - ui osc map");
+    faust_ui_manager_free_oscmap(x);
+    return;
+  }
+  x->f_noscslots = nslots;
+  for (i = 0; i < n; i = j) {
+    size_t k = faust_ui_hash(x->f_oscmap[i].key, nslots - 1);
+    for (j = i + 1; j < n && x->f_oscmap[j].key == x->f_oscmap[i].key; j++) ;
+    while (x->f_oscslots[k].key)
+      k = (k + 1) & (nslots - 1);
+    x->f_oscslots[k].key = x->f_oscmap[i].key;
+    x->f_oscslots[k].start = i;
+    x->f_oscslots[k].end = j;
+  }
+}
+
+static t_faust_osc_slot const *faust_ui_manager_get_oscslot(t_faust_ui_manager const *x, t_symbol const *s)
+{
+  size_t k, mask;
+  if (!x->f_oscslots) return NULL;
+  mask = x->f_noscslots - 1;
+  for (k = faust_ui_hash(s, mask); x->f_oscslots[k].key; k = (k + 1) & mask)
+    if (x->f_oscslots[k].key == s)
+      return x->f_oscslots + k;
+  return NULL;
+}
+
 static void faust_ui_manager_free_uis(t_faust_ui_manager *x)
 {
     t_faust_ui *c = x->f_uis;
@@ -315,19 +733,29 @@ static void faust_ui_manager_free_uis(t_faust_ui_manager *x)
         freebytes(c, sizeof(*c));
         c = x->f_uis;
     }
+    x->f_nuis = 0;
+    faust_ui_manager_free_index(x);
+    faust_ui_manager_free_midimap(x);
+    faust_ui_manager_free_oscmap(x);
     faust_free_voices(x);
 }
 
+// Note that while the ui is being rebuilt, this still finds the controls of
+// the previous build, which are the only ones that we need to look up then.
 static t_faust_ui* faust_ui_manager_get(t_faust_ui_manager const *x, t_symbol const *name)
 {
-    t_faust_ui *c = x->f_uis;
-    while(c)
+    size_t mask, i;
+    if(!x->f_index)
     {
-        if(c->p_name == name || c->p_longname == name)
+        return NULL;
+    }
+    mask = x->f_nindex - 1;
+    for(i = faust_ui_hash(name, mask); x->f_index[i].key; i = (i + 1) & mask)
+    {
+        if(x->f_index[i].key == name)
         {
-            return c;
+            return x->f_index[i].ui;
         }
-        c = c->p_next;
     }
     return NULL;
 }
@@ -350,17 +778,45 @@ static FAUSTFLOAT faustflt(const t_faust_ui_manager *x, FAUSTFLOATX *z)
     return *(float*)z;
 }
 
-static FAUSTFLOAT setfaustflt(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v)
+// Write a zone, or queue the change if we're processing a timed message.
+static FAUSTFLOAT putfaustflt(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v)
 {
+  if (x->f_evoffset > 0 && x->f_events && x->f_nevents >= EVENT_QUEUE_SIZE) {
+    // The queue is full. Apply the pending events right away (a bit early),
+    // so that they can't overwrite this newer change later in the block.
+    faust_ui_manager_apply_events(x, -1);
+  }
+  if (x->f_evoffset > 0 && x->f_events && x->f_nevents < EVENT_QUEUE_SIZE) {
+    // defer the change until the perform routine gets to the event offset
+    t_faust_event *e = x->f_events + x->f_nevents++;
+    e->zone = z;
+    e->value = v;
+    e->offset = x->f_evoffset;
+    return v;
+  }
+  x->f_changed = true;
   if (x->f_isdouble)
     return (*(double*)z = v);
   else
     return (*(float*)z = v);
 }
 
+// Same for control changes by messages. An immediate change must not be
+// overwritten by older changes which are still queued, so these are applied
+// first.
+static FAUSTFLOAT setfaustflt(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v)
+{
+  if (x->f_evoffset <= 0 && x->f_events && x->f_evhead < x->f_nevents) {
+    faust_ui_manager_apply_events(x, -1);
+  }
+  return putfaustflt(x, z, v);
+}
+
 static void faust_ui_manager_prepare_changes(t_faust_ui_manager *x, int isdbl)
 {
     t_faust_ui *c = x->f_uis;
+    // pending events still refer to the old zones
+    faust_ui_manager_apply_events(x, -1);
     faust_ui_manager_all_notes_off(x);
     // Note that here we're still accessing the *old* zone values, so we only
     // update the f_isdouble flag to its new value *after* this has been done.
@@ -449,6 +905,9 @@ static void faust_ui_manager_finish_changes(t_faust_ui_manager *x)
 	faust_ui_manager_sort(x);
 	faust_new_voices(x);
     }
+    faust_ui_manager_build_index(x);
+    faust_ui_manager_build_midimap(x);
+    faust_ui_manager_build_oscmap(x);
 }
 
 static void faust_ui_manager_free_names(t_faust_ui_manager *x)
@@ -592,8 +1051,20 @@ static void faust_ui_manager_add_param(t_faust_ui_manager *x, const char* label,
     c->p_nmidi     = 0;
     c->p_voice     = VOICE_NONE;
     setfaustflt(x, c->p_zone, current);
+    c->p_synced    = current;
+    if (x->f_ninstances && !x->f_gang && !x->f_effect && type != FAUST_UI_TYPE_BARGRAPH &&
+        (last_meta.zone != zone || !last_meta.voice)) {
+      // Multi-instance polyphony uses the standard Faust freq/gain/gate
+      // controls of the voice dsp, which don't need any special meta data.
+      if (strcmp(name->s_name, "freq") == 0)
+        c->p_voice = VOICE_FREQ;
+      else if (strcmp(name->s_name, "gain") == 0)
+        c->p_voice = VOICE_GAIN;
+      else if (strcmp(name->s_name, "gate") == 0)
+        c->p_voice = VOICE_GATE;
+    }
     if (last_meta.zone == zone) {
-      if (last_meta.voice) {
+      if (last_meta.voice && !x->f_effect) {
 	if (c->p_type != FAUST_UI_TYPE_BARGRAPH) {
 	  c->p_voice = last_meta.voice;
 #if 0
@@ -914,10 +1385,9 @@ static void faust_ui_manager_meta_declare(t_faust_ui_manager* x, const char* key
 {
 #if 0
     logpost(x->f_owner, 3, "             %s: %s", key, value);
-    if (strcmp(key, "nvoices") == 0) {
-      pd_error(x->f_owner, "faustgen2~: warning: nvoices declaration not implemented");
-    }
 #endif
+    // Note that the nvoices declaration is handled by the faustgen2~ object,
+    // since it determines the number of dsp instances to be created.
     if (strcmp(key, "options") == 0 && value) {
       // Currently we recognize the standard Faust options 'midi' and 'osc',
       // which are both enabled by default, but you can disable them by
@@ -959,6 +1429,147 @@ static void faust_ui_manager_meta_declare(t_faust_ui_manager* x, const char* key
 }
 
 
+// ZONE TABLES
+//////////////////////////////////////////////////////////////////////////////////////////////////
+
+// In multi-instance polyphony, each voice is a separate instance of the dsp.
+// We only build the full ui for the first instance; for all instances we just
+// record the zones of the ui elements in the order in which they are created,
+// which is the same for all instances of a factory, and coincides with the
+// p_index of the corresponding ui elements.
+
+typedef struct {
+    FAUSTFLOATX** zones;
+    size_t n, size;
+    bool failed;
+} t_faust_zone_list;
+
+static void faust_zone_list_add(t_faust_zone_list* l, FAUSTFLOAT* zone)
+{
+  if (l->n >= l->size) {
+    size_t size = l->size ? 2*l->size : 64;
+    FAUSTFLOATX** zones = (FAUSTFLOATX**)resizebytes(l->zones, l->size*sizeof(FAUSTFLOATX*), size*sizeof(FAUSTFLOATX*));
+    if (!zones) {
+      l->failed = true;
+      return;
+    }
+    l->zones = zones;
+    l->size = size;
+  }
+  l->zones[l->n++] = zone;
+}
+
+static void faust_zone_list_open_box(t_faust_zone_list* l, const char* label)
+{
+}
+
+static void faust_zone_list_close_box(t_faust_zone_list* l)
+{
+}
+
+static void faust_zone_list_add_button(t_faust_zone_list* l, const char* label, FAUSTFLOAT* zone)
+{
+  faust_zone_list_add(l, zone);
+}
+
+static void faust_zone_list_add_number(t_faust_zone_list* l, const char* label, FAUSTFLOAT* zone,
+                                       FAUSTFLOAT init, FAUSTFLOAT min, FAUSTFLOAT max, FAUSTFLOAT step)
+{
+  faust_zone_list_add(l, zone);
+}
+
+static void faust_zone_list_add_bargraph(t_faust_zone_list* l, const char* label,
+                                         FAUSTFLOAT* zone, FAUSTFLOAT min, FAUSTFLOAT max)
+{
+  faust_zone_list_add(l, zone);
+}
+
+static void faust_zone_list_add_sound_file(t_faust_zone_list* l, const char* label, const char* filename, struct Soundfile** sf_zone)
+{
+}
+
+static void faust_zone_list_declare(t_faust_zone_list* l, FAUSTFLOAT* zone, const char* key, const char* value)
+{
+}
+
+static void faust_zone_list_glue(UIGlue* glue, t_faust_zone_list* l)
+{
+    glue->uiInterface            = l;
+    glue->openTabBox             = (openTabBoxFun)faust_zone_list_open_box;
+    glue->openHorizontalBox      = (openHorizontalBoxFun)faust_zone_list_open_box;
+    glue->openVerticalBox        = (openVerticalBoxFun)faust_zone_list_open_box;
+    glue->closeBox               = (closeBoxFun)faust_zone_list_close_box;
+    glue->addButton              = (addButtonFun)faust_zone_list_add_button;
+    glue->addCheckButton         = (addCheckButtonFun)faust_zone_list_add_button;
+    glue->addVerticalSlider      = (addVerticalSliderFun)faust_zone_list_add_number;
+    glue->addHorizontalSlider    = (addHorizontalSliderFun)faust_zone_list_add_number;
+    glue->addNumEntry            = (addNumEntryFun)faust_zone_list_add_number;
+    glue->addHorizontalBargraph  = (addHorizontalBargraphFun)faust_zone_list_add_bargraph;
+    glue->addVerticalBargraph    = (addVerticalBargraphFun)faust_zone_list_add_bargraph;
+    glue->addSoundfile           = (addSoundfileFun)faust_zone_list_add_sound_file;
+    glue->declare                = (declareFun)faust_zone_list_declare;
+}
+
+static void faust_ui_manager_free_saved(t_faust_ui_manager *x);
+
+static void faust_ui_manager_free_zones(t_faust_ui_manager *x)
+{
+    faust_ui_manager_free_saved(x);
+    if(x->f_zones)
+    {
+        freebytes(x->f_zones, x->f_ninstances * x->f_nzones * sizeof(FAUSTFLOATX*));
+    }
+    x->f_zones      = NULL;
+    x->f_nzones     = 0;
+    x->f_ninstances = 0;
+}
+
+static char faust_ui_manager_new_zones(t_faust_ui_manager *x, void** instances, size_t ninstances)
+{
+    size_t i, nzones = 0;
+    UIGlue glue;
+    t_faust_zone_list l = { NULL, 0, 0, false };
+    faust_zone_list_glue(&glue, &l);
+    faust_ui_manager_free_zones(x);
+    for(i = 0; i < ninstances; ++i)
+    {
+        buildUserInterfaceCDSPInstance((llvm_dsp *)instances[i], &glue);
+        if(i == 0)
+        {
+            nzones = l.n;
+        }
+        else if(l.n != (i+1) * nzones)
+        {
+            l.failed = true;
+        }
+    }
+    if(!l.failed && nzones)
+    {
+        x->f_zones = (FAUSTFLOATX**)getbytes(ninstances * nzones * sizeof(FAUSTFLOATX*));
+        if(x->f_zones)
+        {
+            memcpy(x->f_zones, l.zones, ninstances * nzones * sizeof(FAUSTFLOATX*));
+        }
+        else
+        {
+            l.failed = true;
+        }
+    }
+    if(l.zones)
+    {
+        freebytes(l.zones, l.size * sizeof(FAUSTFLOATX*));
+    }
+    if(l.failed)
+    {
+        pd_error(x->f_owner, "faustgen2~: memory allocation failed - voice zones");
+        x->f_zones = NULL;
+        return 1;
+    }
+    x->f_nzones     = nzones;
+    x->f_ninstances = ninstances;
+    return 0;
+}
+
 //////////////////////////////////////////////////////////////////////////////////////////////////
 //                                      PUBLIC INTERFACE                                        //
 //////////////////////////////////////////////////////////////////////////////////////////////////
@@ -988,6 +1599,15 @@ t_faust_ui_manager* faust_ui_manager_new(t_object* owner)
         ui_manager->f_owner     = owner;
         ui_manager->f_uis       = NULL;
         ui_manager->f_nuis      = 0;
+        ui_manager->f_index     = NULL;
+        ui_manager->f_nindex    = 0;
+        ui_manager->f_midimap   = NULL;
+        ui_manager->f_nmidimap  = 0;
+        ui_manager->f_midislots = NULL;
+        ui_manager->f_oscmap    = NULL;
+        ui_manager->f_noscmap   = 0;
+        ui_manager->f_oscslots  = NULL;
+        ui_manager->f_noscslots = 0;
         ui_manager->f_names     = NULL;
         ui_manager->f_nnames    = 0;
         ui_manager->f_isdouble  = false;
@@ -999,6 +1619,18 @@ t_faust_ui_manager* faust_ui_manager_new(t_object* owner)
         ui_manager->f_init_recv = NULL;
         ui_manager->f_active_recv = NULL;
         ui_manager->f_tuning = NULL;
+        ui_manager->f_ninstances = 0;
+        ui_manager->f_zones = NULL;
+        ui_manager->f_nzones = 0;
+        ui_manager->f_saved = NULL;
+        ui_manager->f_effect = false;
+        ui_manager->f_changed = false;
+        ui_manager->f_syncall = false;
+        ui_manager->f_gang = false;
+        ui_manager->f_instance = 0;
+        ui_manager->f_events = NULL;
+        ui_manager->f_nevents = ui_manager->f_evhead = 0;
+        ui_manager->f_evoffset = 0;
         
         ui_manager->f_meta_glue.metaInterface = ui_manager;
         ui_manager->f_meta_glue.declare       = (metaDeclareFun)faust_ui_manager_meta_declare;
@@ -1012,23 +1644,123 @@ void faust_ui_manager_free(t_faust_ui_manager *x)
     freebytes(x, sizeof(*x));
 }
 
-void faust_ui_manager_init(t_faust_ui_manager *x, void* dspinstance, int isdbl)
+static void faust_ui_manager_build(t_faust_ui_manager *x, void* dspinstance, void* effect, int isdbl)
 {
     faust_ui_manager_prepare_changes(x, isdbl);
     buildUserInterfaceCDSPInstance((llvm_dsp *)dspinstance, (UIGlue *)&(x->f_glue));
+    if(effect)
+    {
+        // The controls of the effect section are just added to those of the
+        // voices, but are never treated as voice controls.
+        x->f_effect = true;
+        buildUserInterfaceCDSPInstance((llvm_dsp *)effect, (UIGlue *)&(x->f_glue));
+        x->f_effect = false;
+    }
     faust_ui_manager_finish_changes(x);
     faust_ui_manager_free_names(x);
     metadataCDSPInstance((llvm_dsp *)dspinstance, &x->f_meta_glue);
 }
 
+void faust_ui_manager_init(t_faust_ui_manager *x, void* dspinstance, int isdbl)
+{
+    faust_ui_manager_free_zones(x);
+    x->f_gang = false;
+    faust_ui_manager_build(x, dspinstance, NULL, isdbl);
+}
+
+void faust_ui_manager_init_poly(t_faust_ui_manager *x, void** instances, size_t ninstances, void* effect, int isdbl)
+{
+    faust_ui_manager_new_zones(x, instances, ninstances);
+    x->f_gang = false;
+    faust_ui_manager_build(x, instances[0], effect, isdbl);
+    x->f_changed = x->f_syncall = true;
+}
+
+void faust_ui_manager_init_gang(t_faust_ui_manager *x, void** instances, size_t ninstances, int isdbl)
+{
+    faust_ui_manager_new_zones(x, instances, ninstances);
+    x->f_gang = true;
+    faust_ui_manager_build(x, instances[0], NULL, isdbl);
+    if(x->f_instance > x->f_ninstances)
+    {
+        x->f_instance = 0;
+    }
+    x->f_changed = x->f_syncall = true;
+}
+
+size_t faust_ui_manager_get_ninstances(t_faust_ui_manager const *x)
+{
+    return x->f_ninstances;
+}
+
+// Copy a control value to all instances but the first.
+static void faust_ui_manager_copy_value(t_faust_ui_manager *x, t_faust_ui *c, FAUSTFLOAT v)
+{
+    size_t k;
+    for(k = 1; k < x->f_ninstances; ++k)
+    {
+        // this also runs in the perform routine, which must leave the events
+        // for the rest of the block in the queue
+        putfaustflt(x, x->f_zones[k*x->f_nzones+c->p_index], v);
+    }
+    c->p_synced = v;
+}
+
+void faust_ui_manager_sync_instances(t_faust_ui_manager *x)
+{
+    // Copy the values of all active non-voice controls which changed since
+    // the last sync from the first instance to all other instances. Note that
+    // this only covers the controls of the voice dsp, the effect controls (if
+    // any) aren't in the zone tables. In ganged mode, the voice controls (if
+    // any) are copied as well, so that all instances play in unison.
+    t_faust_ui *c;
+    if(!x->f_changed || x->f_ninstances < 2)
+    {
+        return;
+    }
+    for(c = x->f_uis; c; c = c->p_next)
+    {
+        FAUSTFLOAT v;
+        if((c->p_voice && !x->f_gang) || c->p_type == FAUST_UI_TYPE_BARGRAPH || c->p_index >= x->f_nzones)
+        {
+            continue;
+        }
+        v = faustflt(x, c->p_zone);
+        if(x->f_syncall || v != c->p_synced)
+        {
+            faust_ui_manager_copy_value(x, c, v);
+        }
+    }
+    x->f_changed = x->f_syncall = false;
+}
+
+int faust_ui_manager_voice_state(t_faust_ui_manager const *x, size_t k)
+{
+    if(x->f_ninstances && k < (size_t)x->f_nvoices)
+    {
+        return x->f_voices[k].state;
+    }
+    return STATE_ACTIVE;
+}
+
+void faust_ui_manager_voice_sleep(t_faust_ui_manager *x, size_t k)
+{
+    if(x->f_ninstances && k < (size_t)x->f_nvoices && x->f_voices[k].state == STATE_RELEASE)
+    {
+        x->f_voices[k].state = STATE_IDLE;
+    }
+}
+
 void faust_ui_manager_clear(t_faust_ui_manager *x)
 {
     if (x->f_panic_recv) faust_ui_receive_free(x->f_panic_recv);
     if (x->f_init_recv) faust_ui_receive_free(x->f_init_recv);
     if (x->f_active_recv) faust_ui_receive_free(x->f_active_recv);
     if (x->f_tuning) freebytes(x->f_tuning, 12*sizeof(t_float));
+    faust_ui_manager_enable_events(x, 0);
     faust_ui_manager_free_uis(x);
     faust_ui_manager_free_names(x);
+    faust_ui_manager_free_zones(x);
 }
 
 static void gui_update(FAUSTFLOAT v, t_faust_ui_proxy *r)
@@ -1050,22 +1782,53 @@ static void set_zone(t_faust_ui_manager *x, FAUSTFLOATX *z, FAUSTFLOAT v, t_faus
   gui_update(v, r);
 }
 
+// Set a control in ganged mode. This either sets the control in all
+// instances, or in the instance currently addressed with the instance message.
+static void set_gang_zone(t_faust_ui_manager *x, t_faust_ui *c, FAUSTFLOAT v)
+{
+  // Make sure that pending changes of the first instance have been
+  // propagated, so that they don't clobber the value that we set here.
+  faust_ui_manager_sync_instances(x);
+  if (!x->f_instance) {
+    set_zone(x, c->p_zone, v, c->p_uirecv);
+    faust_ui_manager_copy_value(x, c, v);
+  } else if (x->f_instance == 1) {
+    // only the first instance, which is what the GUI shows
+    set_zone(x, c->p_zone, v, c->p_uirecv);
+    c->p_synced = v;
+  } else {
+    setfaustflt(x, faust_instance_zone(x, x->f_instance-1, c), v);
+  }
+}
+
 char faust_ui_manager_set_value(t_faust_ui_manager *x, t_symbol const *name, t_float const f)
 {
     t_faust_ui* ui = faust_ui_manager_get(x, name);
     if(ui)
     {
+        FAUSTFLOAT v;
         if(ui->p_type == FAUST_UI_TYPE_BUTTON || ui->p_type == FAUST_UI_TYPE_TOGGLE)
         {
-            set_zone(x, ui->p_zone, (FAUSTFLOAT)(f > FLT_EPSILON), ui->p_uirecv);
-            return 0;
+            v = (FAUSTFLOAT)(f > FLT_EPSILON);
         }
         else if(ui->p_type == FAUST_UI_TYPE_NUMBER)
         {
-            const FAUSTFLOAT v = (FAUSTFLOAT)(f);
-            set_zone(x, ui->p_zone, (FAUSTFLOAT)(v < ui->p_min?ui->p_min:v > ui->p_max?ui->p_max:v), ui->p_uirecv);
-            return 0;
+            v = (FAUSTFLOAT)(f);
+            v = (FAUSTFLOAT)(v < ui->p_min?ui->p_min:v > ui->p_max?ui->p_max:v);
         }
+        else
+        {
+            return 1;
+        }
+        if(x->f_gang && ui->p_index < x->f_nzones)
+        {
+            set_gang_zone(x, ui, v);
+        }
+        else
+        {
+            set_zone(x, ui->p_zone, v, ui->p_uirecv);
+        }
+        return 0;
     }
     return 1;
 }
@@ -1075,12 +1838,94 @@ char faust_ui_manager_get_value(t_faust_ui_manager const *x, t_symbol const *nam
     t_faust_ui* ui = faust_ui_manager_get(x, name);
     if(ui)
     {
-        *f = (t_float)(faustflt(x, ui->p_zone));
+        FAUSTFLOATX *z = ui->p_zone;
+        if(x->f_gang && x->f_instance > 1 && ui->p_index < x->f_nzones)
+        {
+            z = faust_instance_zone(x, x->f_instance-1, ui);
+        }
+        *f = (t_float)(faustflt(x, z));
         return 0;
     }
     return 1;
 }
 
+void faust_ui_manager_enable_events(t_faust_ui_manager *x, char enable)
+{
+    if(enable && !x->f_events)
+    {
+        x->f_events = (t_faust_event*)getbytes(EVENT_QUEUE_SIZE * sizeof(t_faust_event));
+        if(!x->f_events)
+        {
+            pd_error(x->f_owner, "faustgen2~: memory allocation failed - event queue");
+        }
+    }
+    else if(!enable && x->f_events)
+    {
+        faust_ui_manager_apply_events(x, -1);
+        freebytes(x->f_events, EVENT_QUEUE_SIZE * sizeof(t_faust_event));
+        x->f_events = NULL;
+    }
+}
+
+void faust_ui_manager_set_event_offset(t_faust_ui_manager *x, int offset)
+{
+    x->f_evoffset = offset;
+}
+
+int faust_ui_manager_next_event(t_faust_ui_manager const *x)
+{
+    return x->f_evhead < x->f_nevents ? x->f_events[x->f_evhead].offset : -1;
+}
+
+void faust_ui_manager_apply_events(t_faust_ui_manager *x, int offset)
+{
+    // Events are queued in chronological order, so we just need to pop them
+    // off the head of the queue until we reach the given offset.
+    while(x->f_evhead < x->f_nevents &&
+          (offset < 0 || x->f_events[x->f_evhead].offset <= offset))
+    {
+        t_faust_event const* e = x->f_events + x->f_evhead++;
+        x->f_changed = true;
+        if(x->f_isdouble)
+        {
+            *(double*)e->zone = e->value;
+        }
+        else
+        {
+            *(float*)e->zone = e->value;
+        }
+    }
+    if(x->f_evhead >= x->f_nevents)
+    {
+        x->f_evhead = x->f_nevents = 0;
+    }
+}
+
+void faust_ui_manager_shift_events(t_faust_ui_manager *x, int n)
+{
+    size_t i;
+    for(i = x->f_evhead; i < x->f_nevents; ++i)
+    {
+        t_faust_event* e = x->f_events + i;
+        e->offset = e->offset > n ? e->offset - n : 0;
+    }
+}
+
+char faust_ui_manager_set_instance(t_faust_ui_manager *x, size_t k)
+{
+    if(!x->f_gang || k > x->f_ninstances)
+    {
+        return 1;
+    }
+    x->f_instance = k;
+    return 0;
+}
+
+size_t faust_ui_manager_get_instance(t_faust_ui_manager const *x)
+{
+    return x->f_instance;
+}
+
 static double round_near(double x, double x0, double min, double max)
 {
   if (fabs(x-x0) < FLT_EPSILON*(max - min)) x = x0;
@@ -1134,6 +1979,9 @@ static void faust_ui_midi_init(void)
     for (int i = 1; i < N_MIDI; i++)
       if (midi_sym_s[i])
 	midi_sym[i] = gensym(midi_sym_s[i]);
+    // populate the midi_slot_base table (see faust_ui_manager_build_midimap)
+    for (int i = 1; i < N_MIDI; i++)
+      midi_slot_base[i] = midi_slot_base[i-1] + (midi_argc[i-1] > 1 ? N_MIDI_NUMS : 1);
   }
 }
 
@@ -1177,9 +2025,10 @@ static void voices_noteon(t_faust_ui_manager *x, int num, int val, int chan)
       pd_error(x->f_owner, "faustgen2~: memory allocation failed - monophony");
     }
     t_faust_voice *v = x->f_voices;
-    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num));
-    if (v->gain_c) setfaustflt(x, v->gain_c->p_zone, ((double)val)/127.0);
-    if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 1.0);
+    if (v->freq_z) setfaustflt(x, v->freq_z, note2cps(x, num));
+    if (v->gain_z) setfaustflt(x, v->gain_z, ((double)val)/127.0);
+    if (v->gate_z) setfaustflt(x, v->gate_z, 1.0);
+    v->state = STATE_ACTIVE;
     return;
   }
 #endif
@@ -1211,9 +2060,10 @@ static void voices_noteon(t_faust_ui_manager *x, int num, int val, int chan)
     // Simply bypass all checking of control ranges and steps for now. We
     // might want to do something more comprehensive later. Also, having MTS
     // support would be nice. :)
-    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, num));
-    if (v->gain_c) setfaustflt(x, v->gain_c->p_zone, ((double)val)/127.0);
-    if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 1.0);
+    if (v->freq_z) setfaustflt(x, v->freq_z, note2cps(x, num));
+    if (v->gain_z) setfaustflt(x, v->gain_z, ((double)val)/127.0);
+    if (v->gate_z) setfaustflt(x, v->gate_z, 1.0);
+    v->state = STATE_ACTIVE;
   }
 }
 
@@ -1240,10 +2090,13 @@ static void voices_noteoff(t_faust_ui_manager *x, int num, int chan)
 	  if (p) {
 	    // legato (change to the previous frequency); note that if you
 	    // want portamento, you'll have to do this in the Faust source
-	    if (v->freq_c) setfaustflt(x, v->freq_c->p_zone, note2cps(x, p->num));
+	    if (v->freq_z) setfaustflt(x, v->freq_z, note2cps(x, p->num));
 	  } else {
 	    // note off
-	    if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 0.0);
+	    if (v->gate_z) {
+	      setfaustflt(x, v->gate_z, 0.0);
+	      v->state = STATE_RELEASE;
+	    }
 	  }
 	  x->f_keys = p;
 	}
@@ -1272,7 +2125,10 @@ static void voices_noteoff(t_faust_ui_manager *x, int num, int chan)
     } else {
       x->f_free = u;
     }
-    if (u->gate_c) setfaustflt(x, u->gate_c->p_zone, 0.0);
+    if (u->gate_z) {
+      setfaustflt(x, u->gate_z, 0.0);
+      u->state = STATE_RELEASE;
+    }
   }
 }
 
@@ -1281,7 +2137,10 @@ void faust_ui_manager_all_notes_off(t_faust_ui_manager *x)
 #if MONOPHONIC
   if (x->f_nvoices == 1) {
     t_faust_voice *v = x->f_voices;
-    if (v->gate_c) setfaustflt(x, v->gate_c->p_zone, 0.0);
+    if (v->gate_z) {
+      setfaustflt(x, v->gate_z, 0.0);
+      if (v->state == STATE_ACTIVE) v->state = STATE_RELEASE;
+    }
     while (x->f_keys) {
       t_faust_key *next = x->f_keys->next;
       freebytes(x->f_keys, sizeof(t_faust_key));
@@ -1291,7 +2150,10 @@ void faust_ui_manager_all_notes_off(t_faust_ui_manager *x)
   }
 #endif
   for (t_faust_voice *u = x->f_used; u; u = u->next_free) {
-    if (u->gate_c) setfaustflt(x, u->gate_c->p_zone, 0.0);
+    if (u->gate_z) {
+      setfaustflt(x, u->gate_z, 0.0);
+      u->state = STATE_RELEASE;
+    }
     u->next_free = u->next_used;
     u->next_used = NULL;
   }
@@ -1325,7 +2187,7 @@ int faust_ui_manager_get_midi(t_faust_ui_manager *x, t_symbol const *s, int argc
     // Process the message arguments. Note that we generally ignore a
     // trailing channel argument here, unless it is needed in matching. We
     // also ignore any other junk that follows.
-    int num, val, chan = -1;
+    int num = 0, val = 0, chan = -1;
     if (argc < midi_argc[i]) return MIDI_NONE;
     if (midi_argc[i] > 0) {
       if (argv[0].a_type != A_FLOAT) return MIDI_NONE;
@@ -1368,65 +2230,55 @@ int faust_ui_manager_get_midi(t_faust_ui_manager *x, t_symbol const *s, int argc
       else
 	voices_noteoff(x, num, chan);
     }
-    // Run through all the active UI elements with MIDI bindings and update
+    // Look up the bindings of the message in the dispatch table and update
     // the elements that match.
-    t_faust_ui *c = x->f_uis;
-    while (c) {
-      for (size_t j = 0; j < c->p_nmidi; j++) {
-	if (c->p_midi[j].msg == i &&
-	    (c->p_midi[j].chan < 0 || c->p_midi[j].chan == chan) &&
-	    c->p_type != FAUST_UI_TYPE_BARGRAPH) {
-	  bool log = true;
-	  switch (i) {
-	  case MIDI_START:
-	    setfaustflt(x, c->p_zone,
-	      translate_from_midi(1, 0, 1,
-				  c->p_type, c->p_min, c->p_max, c->p_step));
-	    break;
-	  case MIDI_STOP:
-	    setfaustflt(x, c->p_zone,
-	      translate_from_midi(0, 0, 1,
-				  c->p_type, c->p_min, c->p_max, c->p_step));
-	    break;
-	  case MIDI_CLOCK:
-	    // square signal which toggles at each clock
-	    if (c->p_type == FAUST_UI_TYPE_BUTTON ||
-		c->p_type == FAUST_UI_TYPE_TOGGLE)
-	      val = faustflt(x, c->p_zone) == 0.0;
-	    else
-	      val = faustflt(x, c->p_zone) == c->p_min;
-	    setfaustflt(x, c->p_zone,
-	      translate_from_midi(val, 0, 1,
-				  c->p_type, c->p_min, c->p_max, c->p_step));
-	    break;
-	  case MIDI_PITCHWHEEL:
-	    setfaustflt(x, c->p_zone,
-	      translate_from_midi(val, 0, 16384,
-				  c->p_type, c->p_min, c->p_max, c->p_step));
-	    break;
-	  default:
-	    if (midi_argc[i] == 1) {
-	      // Pd counts program changes starting at 1
-	      if (i == MIDI_PGM) val--;
-	      setfaustflt(x, c->p_zone,
-		translate_from_midi(val, 0, 128,
-				    c->p_type, c->p_min, c->p_max, c->p_step));
-	    } else if (c->p_midi[j].num == num) {
-	      setfaustflt(x, c->p_zone,
-		translate_from_midi(val, 0, 128,
-				    c->p_type, c->p_min, c->p_max, c->p_step));
-	    } else {
-	      log = false;
-	    }
-	    break;
-	  }
-	  if (log) {
-	    //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
-	    gui_update(faustflt(x, c->p_zone), c->p_uirecv);
-	  }
-	}
+    if (!x->f_midislots) return i;
+    // Pd counts program changes starting at 1
+    if (i == MIDI_PGM) val--;
+    size_t k = midi_slot(i, num);
+    for (size_t j = x->f_midislots[k]; j < x->f_midislots[k+1]; j++) {
+      t_faust_ui *c = x->f_midimap[j].ui;
+      t_faust_midi_ui const *m = x->f_midimap[j].midi;
+      if ((m->chan >= 0 && m->chan != chan) ||
+	  (midi_argc[i] > 1 && m->num != num))
+	continue;
+      switch (i) {
+      case MIDI_START:
+	setfaustflt(x, c->p_zone,
+	  translate_from_midi(1, 0, 1,
+			      c->p_type, c->p_min, c->p_max, c->p_step));
+	break;
+      case MIDI_STOP:
+	setfaustflt(x, c->p_zone,
+	  translate_from_midi(0, 0, 1,
+			      c->p_type, c->p_min, c->p_max, c->p_step));
+	break;
+      case MIDI_CLOCK: {
+	// square signal which toggles at each clock
+	int v;
+	if (c->p_type == FAUST_UI_TYPE_BUTTON ||
+	    c->p_type == FAUST_UI_TYPE_TOGGLE)
+	  v = faustflt(x, c->p_zone) == 0.0;
+	else
+	  v = faustflt(x, c->p_zone) == c->p_min;
+	setfaustflt(x, c->p_zone,
+	  translate_from_midi(v, 0, 1,
+			      c->p_type, c->p_min, c->p_max, c->p_step));
+	break;
       }
-      c = c->p_next;
+      case MIDI_PITCHWHEEL:
+	setfaustflt(x, c->p_zone,
+	  translate_from_midi(val, 0, 16384,
+			      c->p_type, c->p_min, c->p_max, c->p_step));
+	break;
+      default:
+	setfaustflt(x, c->p_zone,
+	  translate_from_midi(val, 0, 128,
+			      c->p_type, c->p_min, c->p_max, c->p_step));
+	break;
+      }
+      //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
+      gui_update(faustflt(x, c->p_zone), c->p_uirecv);
     }
     return i;
   }
@@ -1532,74 +2384,128 @@ const t_symbol *faust_ui_manager_get_osc(t_faust_ui_manager *x, t_symbol const *
     }
     return s;
   }
-  // Run through all the active UI elements with OSC bindings and update
+  // Look up the bindings of the address in the dispatch table and update
   // the elements that match.
-  t_faust_ui *c = x->f_uis;
-  while (c) {
-    if (c->p_type != FAUST_UI_TYPE_BARGRAPH) {
-      for (size_t j = 0; j < c->p_nosc; j++) {
-	bool log = true;
-	if (argc > 1) {
-	  int k, n;
-	  // Multiple arguments are handled by tacking on /0, /1 etc. to the
-	  // message selector, following the OSC Support section in the Faust
-	  // manual. First check whether the symbol actually matches a proper
-	  // prefix of the current message selector.
-	  size_t l = strlen(s->s_name);
-	  if (strncmp(s->s_name, c->p_osc[j].msg->s_name, l) == 0 &&
-	      c->p_osc[j].msg->s_name[l] == '/' &&
-	      sscanf(c->p_osc[j].msg->s_name+l+1, "%d%n", &k, &n) == 1 &&
-	      c->p_osc[j].msg->s_name[n+l+1] == 0 && k>=0 && k<argc &&
-	      argv[k].a_type == A_FLOAT) {
-	    double val = argv[k].a_w.w_float;
-	    // Translate the value to the target range.
-	    setfaustflt(x, c->p_zone,
-	      translate_from_osc(val, c->p_osc[j].a, c->p_osc[j].b,
-				 c->p_type, c->p_min, c->p_max, c->p_step));
-	  } else {
-	    log = false;
-	  }
-	} else if (c->p_osc[j].msg == s &&
-		   (argc == 0 || argv[0].a_type == A_FLOAT)) {
-	  // The Faust manual doesn't say how to handle the case of no
-	  // arguments. Here we just assume a default value of b in that case.
-	  double val = argc > 0 ? argv[0].a_w.w_float : c->p_osc[j].b;
-	  // Translate the value to the target range.
-	  setfaustflt(x, c->p_zone,
-	    translate_from_osc(val, c->p_osc[j].a, c->p_osc[j].b,
-			       c->p_type, c->p_min, c->p_max, c->p_step));
-	} else {
-	  log = false;
-	}
-	if (log) {
-	  //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
-	  gui_update(faustflt(x, c->p_zone), c->p_uirecv);
-	}
-      }
+  t_faust_osc_slot const *slot = faust_ui_manager_get_oscslot(x, s);
+  if (!slot) return s;
+  for (size_t j = slot->start; j < slot->end; j++) {
+    t_faust_ui *c = x->f_oscmap[j].ui;
+    t_faust_osc_ui const *o = x->f_oscmap[j].osc;
+    int k = x->f_oscmap[j].arg;
+    double val;
+    if (argc > 1) {
+      // Multiple arguments are handled by tacking on /0, /1 etc. to the
+      // message selector, following the OSC Support section in the Faust
+      // manual. The argument index of such bindings is in the table.
+      if (k < 0) continue;
+      if (k >= argc) break;
+      if (argv[k].a_type != A_FLOAT) continue;
+      val = argv[k].a_w.w_float;
+    } else {
+      if (k >= 0) break;
+      if (argc > 0 && argv[0].a_type != A_FLOAT) continue;
+      // The Faust manual doesn't say how to handle the case of no
+      // arguments. Here we just assume a default value of b in that case.
+      val = argc > 0 ? argv[0].a_w.w_float : o->b;
     }
-    c = c->p_next;
+    // Translate the value to the target range.
+    setfaustflt(x, c->p_zone,
+      translate_from_osc(val, o->a, o->b,
+			 c->p_type, c->p_min, c->p_max, c->p_step));
+    //logpost(x->f_owner, 3, "%s = %g", c->p_name->s_name, *c->p_zone);
+    gui_update(faustflt(x, c->p_zone), c->p_uirecv);
   }
   return s;
 }
 
+static void faust_ui_manager_free_saved(t_faust_ui_manager *x)
+{
+    if(x->f_saved)
+    {
+        freebytes(x->f_saved, (x->f_ninstances - 1) * x->f_nzones * sizeof(FAUSTFLOAT));
+    }
+    x->f_saved = NULL;
+}
+
 void faust_ui_manager_save_states(t_faust_ui_manager *x)
 {
     t_faust_ui *c = x->f_uis;
+    size_t i;
     while(c)
     {
         c->p_saved = faustflt(x, c->p_zone);
         c = c->p_next;
     }
+    // The other instances may have values of their own (voice controls,
+    // ganged instances addressed individually), save all their zones.
+    faust_ui_manager_free_saved(x);
+    if(x->f_zones && x->f_ninstances > 1)
+    {
+        size_t const n = (x->f_ninstances - 1) * x->f_nzones;
+        x->f_saved = (FAUSTFLOAT*)getbytes(n * sizeof(FAUSTFLOAT));
+        for(i = 0; x->f_saved && i < n; ++i)
+        {
+            x->f_saved[i] = faustflt(x, x->f_zones[x->f_nzones + i]);
+        }
+    }
 }
 
 void faust_ui_manager_restore_states(t_faust_ui_manager *x)
 {
     t_faust_ui *c = x->f_uis;
+    size_t i;
     while(c)
     {
         set_zone(x, c->p_zone, c->p_saved, c->p_uirecv);
         c = c->p_next;
     }
+    if(x->f_saved)
+    {
+        size_t const n = (x->f_ninstances - 1) * x->f_nzones;
+        for(i = 0; i < n; ++i)
+        {
+            setfaustflt(x, x->f_zones[x->f_nzones + i], x->f_saved[i]);
+        }
+        faust_ui_manager_free_saved(x);
+    }
+    else if(x->f_ninstances > 1)
+    {
+        // couldn't save the other instances, at least give them the values
+        // of the first one
+        x->f_syncall = true;
+    }
+    x->f_changed = true;
+}
+
+void faust_ui_manager_copy_values(t_faust_ui_manager const *x, void* dspinstance)
+{
+    t_faust_ui *c;
+    UIGlue glue;
+    t_faust_zone_list l = { NULL, 0, 0, false };
+    faust_zone_list_glue(&glue, &l);
+    buildUserInterfaceCDSPInstance((llvm_dsp *)dspinstance, &glue);
+    if(l.failed)
+    {
+        pd_error(x->f_owner, "faustgen2~: memory allocation failed - copy values");
+    }
+    else
+    {
+        // the zones are in the order of p_index, see the zone tables above
+        for(c = x->f_uis; c; c = c->p_next)
+        {
+            if(c->p_type != FAUST_UI_TYPE_BARGRAPH && c->p_index < l.n)
+            {
+                if(x->f_isdouble)
+                    *(double*)l.zones[c->p_index] = faustflt(x, c->p_zone);
+                else
+                    *(float*)l.zones[c->p_index] = faustflt(x, c->p_zone);
+            }
+        }
+    }
+    if(l.zones)
+    {
+        freebytes(l.zones, l.size * sizeof(FAUSTFLOATX*));
+    }
 }
 
 void faust_ui_manager_restore_default(t_faust_ui_manager *x)
@@ -1625,6 +2531,96 @@ static const char* faust_ui_manager_get_parameter_char(int const type)
         return "bargraph";
 }
 
+void faust_ui_manager_get_memory(t_faust_ui_manager const *x, size_t *ui, size_t *voices)
+{
+    t_faust_ui const *c;
+    t_faust_key const *k;
+    size_t size = sizeof(t_faust_ui_manager);
+    for(c = x->f_uis; c; c = c->p_next)
+    {
+        size += sizeof(t_faust_ui);
+        size += c->p_nmidi * sizeof(t_faust_midi_ui) + c->p_nosc * sizeof(t_faust_osc_ui);
+        if(c->p_uirecv)
+        {
+            size += sizeof(t_faust_ui_proxy);
+        }
+    }
+    size += x->f_nnames * sizeof(t_symbol *);
+    size += x->f_nindex * sizeof(t_faust_ui_entry);
+    size += x->f_nmidimap * sizeof(t_faust_midi_entry);
+    size += x->f_midislots ? (N_MIDI_SLOTS + 1) * sizeof(size_t) : 0;
+    size += x->f_noscmap * sizeof(t_faust_osc_entry);
+    size += x->f_noscslots * sizeof(t_faust_osc_slot);
+    size += x->f_zones ? x->f_ninstances * x->f_nzones * sizeof(FAUSTFLOATX*) : 0;
+    size += x->f_events ? EVENT_QUEUE_SIZE * sizeof(t_faust_event) : 0;
+    size += x->f_tuning ? 12 * sizeof(t_float) : 0;
+    *ui = size;
+    size = x->f_voices ? x->f_nvoices * sizeof(t_faust_voice) : 0;
+    for(k = x->f_keys; k; k = k->next)
+    {
+        size += sizeof(t_faust_key);
+    }
+    *voices = size;
+}
+
+size_t faust_ui_manager_get_controls(t_faust_ui_manager const *x, t_symbol **names, int *midictl, t_symbol **osc, size_t n)
+{
+    t_faust_ui const *c;
+    size_t i = 0, j;
+    for(c = x->f_uis; c; c = c->p_next)
+    {
+        if(c->p_type == FAUST_UI_TYPE_BARGRAPH)
+        {
+            continue;
+        }
+        if(i < n)
+        {
+            names[i]   = c->p_name;
+            midictl[i] = -1;
+            osc[i]     = c->p_nosc ? c->p_osc[0].msg : NULL;
+            for(j = 0; j < c->p_nmidi; ++j)
+            {
+                if(c->p_midi[j].msg == MIDI_CTRL)
+                {
+                    midictl[i] = c->p_midi[j].num;
+                    break;
+                }
+            }
+        }
+        i++;
+    }
+    return i;
+}
+
+static int translate_to_midi(FAUSTFLOAT z, FAUSTFLOAT p_min, FAUSTFLOAT p_max,
+			     int min, int max);
+
+void faust_ui_manager_get_bound_values(t_faust_ui_manager const *x, t_float *midival, t_float *oscval, size_t n)
+{
+    t_faust_ui const *c;
+    size_t i = 0, j;
+    for(c = x->f_uis; c && i < n; c = c->p_next)
+    {
+        FAUSTFLOAT z;
+        if(c->p_type == FAUST_UI_TYPE_BARGRAPH)
+        {
+            continue;
+        }
+        z = faustflt(x, c->p_zone);
+        midival[i] = 0;
+        oscval[i]  = c->p_nosc ? translate_to_osc(z, c->p_min, c->p_max, c->p_type, c->p_osc[0].a, c->p_osc[0].b) : 0;
+        for(j = 0; j < c->p_nmidi; ++j)
+        {
+            if(c->p_midi[j].msg == MIDI_CTRL)
+            {
+                midival[i] = translate_to_midi(z, c->p_min, c->p_max, 0, 128);
+                break;
+            }
+        }
+        i++;
+    }
+}
+
 void faust_ui_manager_print(t_faust_ui_manager const *x, char const log)
 {
     t_faust_ui *c = x->f_uis;
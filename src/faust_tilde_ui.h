@@ -23,6 +23,55 @@ t_faust_ui_manager* faust_ui_manager_new(t_object* owner);
 
 void faust_ui_manager_init(t_faust_ui_manager *x, void* dspinstance, int isdbl);
 
+// Multi-instance polyphony (declare nvoices): The ui is built from the first
+// instance and the (optional) effect instance, the voice controls of all
+// instances are managed by the voice allocator.
+void faust_ui_manager_init_poly(t_faust_ui_manager *x, void** instances, size_t ninstances, void* effect, int isdbl);
+
+// Ganged mode (gang=N): The ui is built from the first instance, parameter
+// changes go to all instances, or to the instance selected with
+// faust_ui_manager_set_instance (1-based, 0 selects all instances).
+void faust_ui_manager_init_gang(t_faust_ui_manager *x, void** instances, size_t ninstances, int isdbl);
+
+char faust_ui_manager_set_instance(t_faust_ui_manager *x, size_t k);
+
+size_t faust_ui_manager_get_instance(t_faust_ui_manager const *x);
+
+size_t faust_ui_manager_get_ninstances(t_faust_ui_manager const *x);
+
+// Sample-accurate timing: While the event offset is nonzero, control changes
+// aren't written to the zones right away, but are queued until the perform
+// routine applies them at the given sample offset in the next block. An
+// immediate change applies the pending events first, so that it can't be
+// overwritten by them.
+void faust_ui_manager_enable_events(t_faust_ui_manager *x, char enable);
+
+void faust_ui_manager_set_event_offset(t_faust_ui_manager *x, int offset);
+
+// Offset of the next pending event, -1 if none.
+int faust_ui_manager_next_event(t_faust_ui_manager const *x);
+
+// Apply all pending events up to the given offset (all events if negative).
+void faust_ui_manager_apply_events(t_faust_ui_manager *x, int offset);
+
+// Move the pending events n samples closer to the block start, after a block
+// of n samples has been computed. Events beyond the end of a block thus take
+// effect in the block they belong to.
+void faust_ui_manager_shift_events(t_faust_ui_manager *x, int n);
+
+void faust_ui_manager_sync_instances(t_faust_ui_manager *x);
+
+// Voice states in multi-instance polyphony. An idle voice doesn't need to be
+// computed at all. A released voice has its gate turned off, but is still
+// computed until its output has decayed, at which point it goes to sleep.
+enum {
+  STATE_IDLE, STATE_ACTIVE, STATE_RELEASE
+};
+
+int faust_ui_manager_voice_state(t_faust_ui_manager const *x, size_t k);
+
+void faust_ui_manager_voice_sleep(t_faust_ui_manager *x, size_t k);
+
 void faust_ui_manager_free(t_faust_ui_manager *x);
 
 void faust_ui_manager_clear(t_faust_ui_manager *x);
@@ -42,8 +91,29 @@ void faust_ui_manager_restore_states(t_faust_ui_manager *x);
 
 void faust_ui_manager_restore_default(t_faust_ui_manager *x);
 
+// Copy the current control values to another instance of the same factory,
+// e.g., for offline rendering. The controls of the instance are matched with
+// ours by their creation order; passive controls are skipped.
+void faust_ui_manager_copy_values(t_faust_ui_manager const *x, void* dspinstance);
+
 void faust_ui_manager_print(t_faust_ui_manager const *x, char const log);
 
+// Memory used by the UI element tables (controls with their MIDI and OSC
+// bindings, receivers, names, lookup tables, zone tables and the event queue)
+// and by the voice tables of the voice allocator, in bytes.
+void faust_ui_manager_get_memory(t_faust_ui_manager const *x, size_t *ui, size_t *voices);
+
+// The names of the active controls, along with the controller number of the
+// first MIDI ctrl binding (-1 if none) and the first OSC address (NULL if
+// none), for at most n controls. Returns the number of active controls.
+size_t faust_ui_manager_get_controls(t_faust_ui_manager const *x, t_symbol **names, int *midictl, t_symbol **osc, size_t n);
+
+// The current values of the active controls as sent through the bindings
+// returned by faust_ui_manager_get_controls, i.e., the MIDI ctrl value
+// (0-127) and the value in the range of the OSC address, for at most n
+// controls. Entries of controls without such a binding are set to 0.
+void faust_ui_manager_get_bound_values(t_faust_ui_manager const *x, t_float *midival, t_float *oscval, size_t n);
+
 int faust_ui_manager_dump(t_faust_ui_manager const *x, t_symbol *s, t_outlet *out, t_symbol *outsym);
 
 void faust_ui_manager_set_tuning(t_faust_ui_manager *x, t_float tuning[12]);
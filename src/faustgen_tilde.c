@@ -12,6 +12,7 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <errno.h>
 #include <sys/stat.h>
 
 // ag: I'm not sure what this definition is supposed to do, but this will
@@ -26,6 +27,11 @@
 #include "faust_tilde_ui.h"
 #include "faust_tilde_io.h"
 #include "faust_tilde_options.h"
+#include "faust_tilde_resampler.h"
+#include "faust_tilde_stats.h"
+#include "faust_tilde_trace.h"
+#include "faust_tilde_perf.h"
+#include "faust_tilde_render.h"
 
 #define FAUSTGEN_VERSION_STR "2.0.2"
 #define MAXFAUSTSTRING 4096
@@ -42,11 +48,51 @@
 // change their values.
 const double gui_update_time = 40;
 
+// ag: Default tail time (msec) and silence threshold (about -100 dB) of the
+// auto-sleep mode.
+#define SLEEP_TAIL_TIME 500
+#define SLEEP_LEVEL 0.00001
+
+// ag: Compile stages, for the timing breakdown, the trace and the load
+// profile. Parsing, expansion and the LLVM backend all happen in the single
+// libfaust factory call, so they show up as one stage.
+enum
+{
+    FAUSTGEN_STAGE_PATH,
+    FAUSTGEN_STAGE_FACTORY,
+    FAUSTGEN_STAGE_INSTANCE,
+    FAUSTGEN_STAGE_VOICES,
+    FAUSTGEN_STAGE_UI,
+    FAUSTGEN_STAGE_GUI,
+    FAUSTGEN_STAGE_TOTAL,
+    FAUSTGEN_NSTAGES
+};
+
+static char const* faustgen_compile_stages[FAUSTGEN_NSTAGES] =
+{
+    "path", "factory", "instance", "voices", "ui", "gui", "compile"
+};
+
 typedef struct _faustgen_tilde
 {
     t_object            f_obj;
     llvm_dsp_factory*   f_dsp_factory;
     llvm_dsp*           f_dsp_instance;
+
+    // multi-instance polyphony (declare nvoices), f_instances[0] is always
+    // the main instance above; f_effect_instance is the optional effect
+    llvm_dsp**          f_instances;
+    size_t              f_ninstances;
+    size_t              f_voice_noutputs;
+    llvm_dsp_factory*   f_effect_factory;
+    llvm_dsp*           f_effect_instance;
+    // ganged mode (gang=N creation argument), f_instances then holds f_gang
+    // independent copies of the dsp, each with its own set of signal iolets
+    size_t              f_gang;
+    // Pd 0.54+ multichannel iolets (mc= creation argument): number of
+    // multichannel iolets on each side, 0 = off, -1 = default (one per
+    // ganged instance, or just one)
+    int                 f_mc;
     
     float**             f_signal_matrix_single;
     float*              f_signal_aligned_single;
@@ -54,6 +100,78 @@ typedef struct _faustgen_tilde
     double**            f_signal_matrix_double;
     double*             f_signal_aligned_double;
     
+    // pointers into the signal matrix for computing sub-blocks
+    void**              f_signal_offsets;
+    size_t              f_nsignals;
+    
+    // sample-accurate timing (accurate= creation argument): minimum
+    // sub-block size in samples, 0 disables timestamping of messages
+    int                 f_accurate;
+    double              f_tick_time;
+    t_float             f_samplerate;
+    int                 f_blocksize;
+    
+    // oversampling and decimation (oversample= and decimate= creation
+    // arguments): the dsp runs at f_oversample times or 1/f_decimate of
+    // the Pd sample rate, 1 means no resampling
+    int                 f_oversample;
+    int                 f_decimate;
+    t_faust_resampler*  f_resampler;
+    
+    // control-rate mode (controlrate= creation argument): the dsp computes
+    // a single sample per Pd block, at a sample rate of sr/blocksize
+    bool                f_controlrate;
+    
+    // auto-sleep (autosleep= creation argument): once inputs and outputs
+    // have stayed below f_sleep_level for f_sleep_time msecs, computing is
+    // suspended until the input returns or a message arrives
+    double              f_sleep_time;
+    t_sample            f_sleep_level;
+    int                 f_sleep_tail;
+    int                 f_sleep_quiet;
+    bool                f_asleep;
+    bool                f_wakeup;
+    long                f_sleep_skipped;
+    
+    // load meter (load= creation argument): compute time of each block as a
+    // fraction of the block period, NULL if the meter is off
+    t_faust_stats*      f_load;
+    
+    // hardware performance counters of the compute calls ('perfcount 1'),
+    // NULL if off
+    t_faust_perf*       f_perf;
+    
+    // offline rendering into arrays ('render' message), NULL if none; this
+    // runs a copy of the instance, possibly on a worker thread
+    t_faust_render*     f_render;
+    
+    // offline benchmark ('bench' message) on a worker thread, NULL if none
+    t_faust_render*     f_bench;
+    
+    // entry of the dsp in the global statistics registry, the number of
+    // bytes allocated for the signal buffers and fifo, and the memory
+    // footprint of the object last reported to the registry
+    t_faust_stats_entry* f_stats;
+    long                f_memory;
+    long                f_memory_reported;
+    
+    // duration of the stages of the last compile in secs, see the
+    // faustgen_compile_stages table
+    double              f_compile_time[FAUSTGEN_NSTAGES];
+    
+    // internal block size (blocksize= creation argument), 0 means Pd's
+    // block size; larger sizes go through a FIFO (f_fifo_size > 0), smaller
+    // ones split each Pd block into chunks
+    int                 f_iblocksize;
+    int                 f_fifo_size;
+    int                 f_fifo_fill;
+    int                 f_fifo_count;
+    int                 f_fifo_latency;
+    size_t              f_fifo_noutputs;
+    t_sample**          f_fifo_outputs;
+    t_sample**          f_fifo_ptrs;
+    t_sample*           f_fifo_aligned;
+    
     t_faust_ui_manager* f_ui_manager;
     t_faust_io_manager* f_io_manager;
     t_faust_opt_manager* f_opt_manager;
@@ -85,8 +203,33 @@ static t_class *faustgen_tilde_class;
 //                                          FAUST INTERFACE                                     //
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
+static void faustgen_tilde_delete_voices(llvm_dsp** instances, size_t ninstances)
+{
+    size_t i;
+    if(instances)
+    {
+        // the first instance is the main instance which is deleted elsewhere
+        for(i = 1; i < ninstances; ++i)
+        {
+            if(instances[i])
+            {
+                deleteCDSPInstance(instances[i]);
+            }
+        }
+        freebytes(instances, ninstances * sizeof(llvm_dsp*));
+    }
+}
+
 static void faustgen_tilde_delete_instance(t_faustgen_tilde *x)
 {
+    faustgen_tilde_delete_voices(x->f_instances, x->f_ninstances);
+    x->f_instances  = NULL;
+    x->f_ninstances = 0;
+    if(x->f_effect_instance)
+    {
+        deleteCDSPInstance(x->f_effect_instance);
+    }
+    x->f_effect_instance = NULL;
     if(x->f_dsp_instance)
     {
         deleteCDSPInstance(x->f_dsp_instance);
@@ -96,7 +239,23 @@ static void faustgen_tilde_delete_instance(t_faustgen_tilde *x)
 
 static void faustgen_tilde_delete_factory(t_faustgen_tilde *x)
 {
+    // a render or bench still running needs the code of the factory
+    if(x->f_render)
+    {
+        faust_render_free(x->f_render);
+        x->f_render = NULL;
+    }
+    if(x->f_bench)
+    {
+        faust_render_free(x->f_bench);
+        x->f_bench = NULL;
+    }
     faustgen_tilde_delete_instance(x);
+    if(x->f_effect_factory)
+    {
+        deleteCDSPFactory(x->f_effect_factory);
+    }
+    x->f_effect_factory = NULL;
     if(x->f_dsp_factory)
     {
         deleteCDSPFactory(x->f_dsp_factory);
@@ -104,15 +263,214 @@ static void faustgen_tilde_delete_factory(t_faustgen_tilde *x)
     x->f_dsp_factory = NULL;
 }
 
+// ag: Multi-instance polyphony. This follows the standard Faust polyphony
+// model: If the dsp declares nvoices, we create that many instances of the
+// dsp, the standard freq/gain/gate controls of which are handled by the voice
+// allocator, and mix their outputs. If the dsp also defines an effect, it is
+// compiled separately, and the mixed voice outputs are fed into the effect.
+
+static void faustgen_tilde_nvoices_declare(int* nvoices, const char* key, const char* value)
+{
+    if(!strcmp(key, "nvoices") && value)
+    {
+        int n;
+        // the value may or may not be quoted
+        if(sscanf(value, "%d", &n) == 1 || sscanf(value, "\"%d", &n) == 1)
+        {
+            *nvoices = n;
+        }
+    }
+}
+
+static int faustgen_tilde_get_nvoices(llvm_dsp* instance)
+{
+    int nvoices = 0;
+    MetaGlue glue;
+    glue.metaInterface = &nvoices;
+    glue.declare       = (metaDeclareFun)faustgen_tilde_nvoices_declare;
+    metadataCDSPInstance(instance, &glue);
+    return nvoices > 0 ? nvoices : 0;
+}
+
+static llvm_dsp** faustgen_tilde_new_voices(t_faustgen_tilde *x, llvm_dsp_factory* factory, llvm_dsp* instance, size_t nvoices)
+{
+    size_t i;
+    llvm_dsp** instances = (llvm_dsp**)getzbytes(nvoices * sizeof(llvm_dsp*));
+    if(!instances)
+    {
+        pd_error(x, "faustgen2~: memory allocation failed - voices");
+        return NULL;
+    }
+    instances[0] = instance;
+    for(i = 1; i < nvoices; ++i)
+    {
+        instances[i] = createCDSPInstance(factory);
+        if(!instances[i])
+        {
+            pd_error(x, "faustgen2~: memory allocation failed - voice %i", (int)i);
+            faustgen_tilde_delete_voices(instances, nvoices);
+            return NULL;
+        }
+    }
+    return instances;
+}
+
+static llvm_dsp* faustgen_tilde_new_effect(t_faustgen_tilde *x, char const* filepath, int noptions, char const** options,
+                                           int nvoice_outputs, llvm_dsp_factory** effect_factory)
+{
+    // The effect is just the 'effect' definition in the dsp source, which
+    // is compiled with the same options as the voice dsp. It's perfectly
+    // fine if there's no such definition, so we don't report any errors here.
+    int i;
+    llvm_dsp* effect = NULL;
+    llvm_dsp_factory* factory;
+    char errors[MAXFAUSTSTRING];
+    char const** eoptions = (char const**)getbytes((noptions + 2) * sizeof(char const*));
+    *effect_factory = NULL;
+    if(!eoptions)
+    {
+        pd_error(x, "faustgen2~: memory allocation failed - effect options");
+        return NULL;
+    }
+    for(i = 0; i < noptions; ++i)
+    {
+        eoptions[i] = options[i];
+    }
+    eoptions[noptions]   = "-pn";
+    eoptions[noptions+1] = "effect";
+    *errors = 0;
+    factory = createCDSPFactoryFromFile(filepath, noptions + 2, eoptions, "", errors, -1);
+    freebytes(eoptions, (noptions + 2) * sizeof(char const*));
+    if(!factory || strnlen(errors, MAXFAUSTSTRING))
+    {
+        if(factory)
+        {
+            deleteCDSPFactory(factory);
+        }
+        return NULL;
+    }
+    effect = createCDSPInstance(factory);
+    if(!effect)
+    {
+        pd_error(x, "faustgen2~: memory allocation failed - effect instance");
+        deleteCDSPFactory(factory);
+        return NULL;
+    }
+    if(getNumInputsCDSPInstance(effect) != nvoice_outputs)
+    {
+        pd_error(x, "faustgen2~: effect has %d inputs, but the voices have %d outputs - effect ignored",
+                 getNumInputsCDSPInstance(effect), nvoice_outputs);
+        deleteCDSPInstance(effect);
+        deleteCDSPFactory(factory);
+        return NULL;
+    }
+    *effect_factory = factory;
+    return effect;
+}
+
+// ag: libfaust keeps a cache of the factories in use, keyed by the SHA key of
+// the expanded source and the options, and hands out the cached factory when
+// the same dsp is compiled again. The list of keys in use before a compile
+// tells us whether the resulting factory was a cache hit. This also frees
+// the list.
+static bool faustgen_tilde_is_cached(llvm_dsp_factory* factory, char const** keys)
+{
+    bool cached = false;
+    if(keys)
+    {
+        char* key = factory ? getCSHAKey(factory) : NULL;
+        size_t i;
+        for(i = 0; keys[i]; ++i)
+        {
+            cached = cached || (key && !strcmp(keys[i], key));
+            free((void*)keys[i]);
+        }
+        free(keys);
+        free(key);
+    }
+    return cached;
+}
+
+// Format the compile time breakdown of the last compile, in msecs.
+static char const* faustgen_tilde_format_compile_time(t_faustgen_tilde *x, char* buf, size_t size)
+{
+    int i, n;
+    n = snprintf(buf, size, "%g msec (", x->f_compile_time[FAUSTGEN_STAGE_TOTAL] * 1000.0);
+    for(i = 0; i < FAUSTGEN_STAGE_TOTAL && n < (int)size; ++i)
+    {
+        n += snprintf(buf + n, size - n, "%s%s %g", i ? ", " : "",
+                      faustgen_compile_stages[i], x->f_compile_time[i] * 1000.0);
+    }
+    if(n < (int)size)
+    {
+        snprintf(buf + n, size - n, ")");
+    }
+    return buf;
+}
+
+// Size of the generated LLVM IR in bytes, as a measure of the code size.
+// Since this serializes the whole module, it is only done on request.
+static long faustgen_tilde_get_code_size(t_faustgen_tilde *x)
+{
+    long size = 0;
+    if(x->f_dsp_factory)
+    {
+        char* text = writeCDSPFactoryToIR(x->f_dsp_factory);
+        if(text)
+        {
+            size = (long)strlen(text);
+            free(text);
+        }
+    }
+    return size;
+}
+
+// ag: Memory footprint of the object, as far as we can tell. libfaust
+// doesn't report the size of the JIT module or the instance state, so this
+// covers our own buffers (signals, fifo and resampler), the UI element
+// tables and the voice tables. Returns the total in bytes.
+static long faustgen_tilde_get_memory(t_faustgen_tilde *x, long *buffers, long *ui, long *voices)
+{
+    size_t uisize, voicesize;
+    faust_ui_manager_get_memory(x->f_ui_manager, &uisize, &voicesize);
+    *buffers = x->f_memory + (long)faust_resampler_get_memory(x->f_resampler);
+    *ui      = (long)uisize;
+    *voices  = (long)(voicesize + (x->f_instances ? x->f_ninstances * sizeof(llvm_dsp*) : 0));
+    return *buffers + *ui + *voices;
+}
+
+// Update the object's share of the memory in the global registry.
+static void faustgen_tilde_update_memory(t_faustgen_tilde *x)
+{
+    long buffers, ui, voices;
+    long const total = faustgen_tilde_get_memory(x, &buffers, &ui, &voices);
+    faust_stats_registry_memory(x->f_stats, total - x->f_memory_reported);
+    x->f_memory_reported = total;
+}
+
+// Record the duration of a compile stage which began at start, and return
+// the current time as the start of the next stage.
+static double faustgen_tilde_end_stage(t_faustgen_tilde *x, int stage, double start)
+{
+    double const now = faust_stats_gettime();
+    x->f_compile_time[stage] = now - start;
+    faust_trace_end(faustgen_compile_stages[stage], "compile", x->f_dsp_name, start);
+    return now;
+}
+
 static void faustgen_tilde_compile(t_faustgen_tilde *x)
 {
     char const* filepath;
+    double const start = faust_stats_gettime();
+    double span = start;
     int dspstate = canvas_suspend_dsp();
     if(!x->f_dsp_name)
     {
         return;
     }
+    memset(x->f_compile_time, 0, sizeof(x->f_compile_time));
     filepath = faust_opt_manager_get_full_path(x->f_opt_manager, x->f_dsp_name->s_name);
+    span = faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_PATH, span);
     if(filepath)
     {
         llvm_dsp* instance;
@@ -120,8 +478,12 @@ static void faustgen_tilde_compile(t_faustgen_tilde *x)
         char errors[MAXFAUSTSTRING];
         int noptions            = (int)faust_opt_manager_get_noptions(x->f_opt_manager);
         char const** options    = faust_opt_manager_get_options(x->f_opt_manager);
+        char const** cached     = getAllCDSPFactories();
+        bool cachehit;
         
         factory = createCDSPFactoryFromFile(filepath, noptions, options, "", errors, -1);
+        span = faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_FACTORY, span);
+        cachehit = faustgen_tilde_is_cached(factory, cached);
         if(strnlen(errors, MAXFAUSTSTRING))
         {
             pd_error(x, "faustgen2~: try to load %s", filepath);
@@ -133,23 +495,91 @@ static void faustgen_tilde_compile(t_faustgen_tilde *x)
         }
         
         instance = createCDSPInstance(factory);
+        span = faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_INSTANCE, span);
         if(instance)
         {
             const int ninputs = getNumInputsCDSPInstance(instance);
-            const int noutputs = getNumOutputsCDSPInstance(instance);
+            const int nvoice_outputs = getNumOutputsCDSPInstance(instance);
+            int noutputs = nvoice_outputs;
+            size_t nvoices = (size_t)faustgen_tilde_get_nvoices(instance);
+            llvm_dsp** instances = NULL;
+            llvm_dsp* effect = NULL;
+            llvm_dsp_factory* effect_factory = NULL;
+            if(x->f_gang)
+            {
+                // ganged mode takes precedence over polyphony
+                if(nvoices)
+                {
+                    logpost(x, 3, "faustgen2~: ganged mode, nvoices ignored");
+                }
+                nvoices = x->f_gang;
+                instances = faustgen_tilde_new_voices(x, factory, instance, nvoices);
+            }
+            else if(nvoices)
+            {
+                instances = faustgen_tilde_new_voices(x, factory, instance, nvoices);
+                if(instances)
+                {
+                    effect = faustgen_tilde_new_effect(x, filepath, noptions, options, nvoice_outputs, &effect_factory);
+                }
+                if(effect)
+                {
+                    noutputs = getNumOutputsCDSPInstance(effect);
+                }
+            }
+            if(nvoices)
+            {
+                span = faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_VOICES, span);
+            }
             logpost(x, 3, "faustgen2~ %s (%d/%d)", x->f_dsp_name->s_name, ninputs, noutputs);
-            faust_ui_manager_init(x->f_ui_manager, instance, faust_opt_has_double_precision(x->f_opt_manager));
-            faust_io_manager_init(x->f_io_manager, ninputs, noutputs);
+            // ag: with multichannel signals, the channels (of all ganged
+            // instances, in instance order) are split evenly among f_mc
+            // inlets and outlets; by default, each ganged instance gets its
+            // own pair, otherwise all channels go into a single one
+            faust_io_manager_set_multichannel(x->f_io_manager, x->f_mc >= 0 ? (size_t)x->f_mc :
+                                              x->f_gang ? x->f_gang : 1);
+            span = faust_stats_gettime();
+            if(instances && x->f_gang)
+            {
+                faust_ui_manager_init_gang(x->f_ui_manager, (void**)instances, nvoices, faust_opt_has_double_precision(x->f_opt_manager));
+                faust_io_manager_init(x->f_io_manager, ninputs * (int)nvoices, noutputs * (int)nvoices);
+            }
+            else if(instances)
+            {
+                faust_ui_manager_init_poly(x->f_ui_manager, (void**)instances, nvoices, effect, faust_opt_has_double_precision(x->f_opt_manager));
+                faust_io_manager_init(x->f_io_manager, ninputs, noutputs);
+            }
+            else
+            {
+                faust_ui_manager_init(x->f_ui_manager, instance, faust_opt_has_double_precision(x->f_opt_manager));
+                faust_io_manager_init(x->f_io_manager, ninputs, noutputs);
+            }
+            span = faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_UI, span);
             
             faustgen_tilde_delete_instance(x);
             faustgen_tilde_delete_factory(x);
             
             x->f_dsp_factory  = factory;
             x->f_dsp_instance = instance;
-            if (x->f_unique_name && x->f_instance_name)
+            x->f_instances    = instances;
+            x->f_ninstances   = instances ? nvoices : 0;
+            x->f_voice_noutputs   = (size_t)nvoice_outputs;
+            x->f_effect_factory   = effect_factory;
+            x->f_effect_instance  = effect;
+            if (x->f_unique_name && x->f_instance_name) {
               // recreate the Pd GUI
               faust_ui_manager_gui(x->f_ui_manager,
                                    x->f_unique_name, x->f_instance_name);
+              faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_GUI, span);
+            }
+            faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_TOTAL, start);
+            faustgen_tilde_update_memory(x);
+            faust_stats_registry_compile(x->f_stats, x->f_compile_time[FAUSTGEN_STAGE_TOTAL], cachehit);
+            {
+              char buf[MAXPDSTRING];
+              logpost(x, 3, "faustgen2~ %s: compiled in %s", x->f_dsp_name->s_name,
+                      faustgen_tilde_format_compile_time(x, buf, MAXPDSTRING));
+            }
             canvas_resume_dsp(dspstate);
             return;
         }
@@ -285,6 +715,47 @@ static void faustgen_tilde_print(t_faustgen_tilde *x)
         if (x->f_instance_name)
           post("instance name: %s", x->f_instance_name->s_name);
         faust_io_manager_print(x->f_io_manager, 0);
+        if(x->f_ninstances && x->f_gang)
+          post("ganged instances: %d", (int)x->f_ninstances);
+        else if(x->f_ninstances)
+          post("voices: %d%s", (int)x->f_ninstances,
+               x->f_effect_instance ? " (with effect)" : "");
+        if(x->f_controlrate)
+          post("control-rate mode: 1 sample per block");
+        else if(x->f_oversample > 1)
+          post("oversampling: %dx (latency: %d samples)", x->f_oversample,
+               faust_resampler_get_latency(x->f_oversample, 0));
+        else if(x->f_decimate > 1)
+          post("decimation: 1/%d (latency: %d samples)", x->f_decimate,
+               faust_resampler_get_latency(x->f_decimate, 1));
+        if(x->f_sleep_time > 0)
+          post("autosleep: %g msec below %g (%s, %ld blocks skipped)",
+               x->f_sleep_time, x->f_sleep_level,
+               x->f_asleep ? "sleeping" : "awake", x->f_sleep_skipped);
+        if(x->f_load && faust_stats_get_count(x->f_load))
+          post("load: %g mean, %g max, %g p99 (%lu blocks)",
+               faust_stats_get_mean(x->f_load), faust_stats_get_max(x->f_load),
+               faust_stats_get_percentile(x->f_load, 0.99),
+               (unsigned long)faust_stats_get_count(x->f_load));
+        if(x->f_perf && faust_perf_get_samples(x->f_perf))
+          post("perfcount: %g cycles, %g instructions, %g cache misses, %g branch misses per sample",
+               faust_perf_get(x->f_perf, FAUST_PERF_CYCLES),
+               faust_perf_get(x->f_perf, FAUST_PERF_INSTRUCTIONS),
+               faust_perf_get(x->f_perf, FAUST_PERF_CACHE_MISSES),
+               faust_perf_get(x->f_perf, FAUST_PERF_BRANCH_MISSES));
+        {
+            char buf[MAXPDSTRING];
+            post("compile time: %s", faustgen_tilde_format_compile_time(x, buf, MAXPDSTRING));
+        }
+        post("code size: %ld bytes of LLVM IR", faustgen_tilde_get_code_size(x));
+        {
+            long buffers, ui, voices;
+            long const total = faustgen_tilde_get_memory(x, &buffers, &ui, &voices);
+            post("memory: %ld bytes (buffers %ld, ui %ld, voices %ld)", total, buffers, ui, voices);
+        }
+        if(x->f_iblocksize && !x->f_controlrate)
+          post("internal block size: %d (latency: %d samples)", x->f_iblocksize,
+               x->f_fifo_latency);
         if(x->f_dsp_factory)
         {
             char* text = NULL;
@@ -364,6 +835,33 @@ static void faustgen_tilde_dump(t_faustgen_tilde *x, t_symbol *outsym)
 	  free(text);
 	}
       }
+      {
+	// compile time in msecs: total, followed by the stages
+	t_atom av[FAUSTGEN_NSTAGES];
+	int i;
+	SETFLOAT(av, x->f_compile_time[FAUSTGEN_STAGE_TOTAL] * 1000.0);
+	for (i = 0; i < FAUSTGEN_STAGE_TOTAL; i++)
+	  SETFLOAT(av+i+1, x->f_compile_time[i] * 1000.0);
+	out_anything(outsym, out, gensym("compile-time"), FAUSTGEN_NSTAGES, av);
+	SETFLOAT(argv, faustgen_tilde_get_code_size(x));
+	out_anything(outsym, out, gensym("code-size"), 1, argv);
+      }
+      {
+	// memory in bytes: total, buffers, ui, voices
+	t_atom av[4];
+	long buffers, ui, voices;
+	SETFLOAT(av, faustgen_tilde_get_memory(x, &buffers, &ui, &voices));
+	SETFLOAT(av+1, buffers);
+	SETFLOAT(av+2, ui);
+	SETFLOAT(av+3, voices);
+	out_anything(outsym, out, gensym("memory"), 4, av);
+      }
+      if (x->f_sleep_time > 0) {
+	SETFLOAT(argv, x->f_asleep);
+	out_anything(outsym, out, gensym("sleeping"), 1, argv);
+	SETFLOAT(argv, x->f_sleep_skipped);
+	out_anything(outsym, out, gensym("skipped"), 1, argv);
+      }
       numparams = faust_ui_manager_dump(x->f_ui_manager, gensym("param"), out, outsym);
       SETFLOAT(argv, numparams);
       out_anything(outsym, out, gensym("numparams"), 1, argv);
@@ -641,7 +1139,7 @@ static void faustgen_tilde_midichan(t_faustgen_tilde *x, t_symbol* s, int argc,
 //                                  PURE DATA GENERIC INTERFACE                                 //
 //////////////////////////////////////////////////////////////////////////////////////////////////
 
-static void faustgen_tilde_anything(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+static void faustgen_tilde_message(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
 {
     if(x->f_dsp_instance)
     {
@@ -714,117 +1212,1289 @@ static void faustgen_tilde_anything(t_faustgen_tilde *x, t_symbol* s, int argc,
     pd_error(x, "faustgen2~: no dsp instance");
 }
 
-static t_int *faustgen_tilde_perform_single(t_int *w)
+// ag: Sample offset of the current message in the next block, for
+// sample-accurate timing. Messages arriving between two dsp ticks are mapped
+// to the corresponding position in the next block. With a Pd block size
+// smaller than the scheduler tick, the object is computed several times per
+// tick, so the offset may extend across these blocks; the events which are
+// left over at the end of a block are moved into the next one. We fall back
+// to an immediate change if the message falls outside the tick (e.g., if dsp
+// is off). With an internal block size larger than Pd's, the offset is
+// relative to the internal block, which already holds f_fifo_fill samples.
+// If this reaches beyond the end of the internal block, the event stays in
+// the queue and takes effect at its position in the following one.
+// In control-rate mode, all changes take effect in the next block anyway.
+static int faustgen_tilde_event_offset(t_faustgen_tilde *x)
 {
-    int i, j;
-    llvm_dsp *dsp = (llvm_dsp *)w[1];
-    int const nsamples  = (int)w[2];
-    int const ninputs   = (int)w[3];
-    int const noutputs  = (int)w[4];
-    float** faustsigs   = (float **)w[5];
-    t_sample const** realinputs = (t_sample const**)w[6];
-    t_sample** realoutputs      = (t_sample **)w[7];
-    t_faustgen_tilde *x = (t_faustgen_tilde *)w[8];
-    if (!x->f_active) {
-      // ag: default `active` flag: bypass or mute the dsp
-      if (ninputs == noutputs) {
-	for (i = 0; i < ninputs; ++i) {
-	  for(j = 0; j < nsamples; ++j) {
-	    realoutputs[i][j] = realinputs[i][j];
-	  }
-	}
-      } else {
-	for (i = 0; i < noutputs; ++i) {
-	  for(j = 0; j < nsamples; ++j) {
-	    realoutputs[i][j] = 0.0;
-	  }
-	}
-      }
-      return (w+9);
-    }
-    for(i = 0; i < ninputs; ++i)
+    if(x->f_accurate && x->f_samplerate > 0 && !x->f_controlrate)
     {
-        for(j = 0; j < nsamples; ++j)
+        double const n = clock_gettimesince(x->f_tick_time) * x->f_samplerate / 1000.0;
+        double const tick = (double)sys_getblksize() * x->f_samplerate / sys_getsr();
+        if(n >= 1.0 && n < (x->f_blocksize > tick ? x->f_blocksize : tick))
         {
-            faustsigs[i][j] = (FAUSTFLOAT)realinputs[i][j];
+            return x->f_fifo_fill + (int)n;
         }
+        return x->f_fifo_fill;
     }
-    computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
-    for(i = 0; i < noutputs; ++i)
+    return 0;
+}
+
+static void faustgen_tilde_anything(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+    // any message may make a sleeping dsp produce sound again
+    x->f_wakeup = true;
+    faust_ui_manager_set_event_offset(x->f_ui_manager, faustgen_tilde_event_offset(x));
+    faustgen_tilde_message(x, s, argc, argv);
+    faust_ui_manager_set_event_offset(x->f_ui_manager, 0);
+}
+
+static void faustgen_tilde_set_accurate(t_faustgen_tilde *x, int n)
+{
+    x->f_accurate = n > 0 ? n : 0;
+    faust_ui_manager_enable_events(x->f_ui_manager, x->f_accurate > 0);
+}
+
+static void faustgen_tilde_accurate(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Sample-accurate timing of control messages; the argument is the
+  // minimum sub-block size in samples, 0 turns it off.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av;
+    SETFLOAT(&av, x->f_accurate);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT && argv[0].a_w.w_float >= 0) {
+    faustgen_tilde_set_accurate(x, (int)argv[0].a_w.w_float);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad sub-block size '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_set_oversample(t_faustgen_tilde *x, int n)
+{
+    if(n < 1 || n > FAUST_RESAMPLER_MAXFACTOR)
     {
-        for(j = 0; j < nsamples; ++j)
+        pd_error(x, "faustgen2~: oversampling factor must be between 1 and %d", FAUST_RESAMPLER_MAXFACTOR);
+        return;
+    }
+    if(n != x->f_oversample)
+    {
+        // restarting dsp reinitializes the instances at the new sample rate
+        int dspstate = canvas_suspend_dsp();
+        x->f_oversample = n;
+        if(n > 1)
         {
-            realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+            x->f_decimate = 1;
         }
+        canvas_resume_dsp(dspstate);
     }
-    if (x->f_midiout || x->f_midirecv) {
-      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
-    }
-    if (clock_getsystime() >= x->f_next_tick) {
-      if (x->f_oscout || x->f_oscrecv) {
-	t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-	faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
-      }
-      if (x->f_instance_name && x->f_instance_name->s_thing)
-	faust_ui_manager_gui_update(x->f_ui_manager);
-      x->f_next_tick = clock_getsystimeafter(gui_update_time);
-    }
-    return (w+9);
 }
 
-static t_int *faustgen_tilde_perform_double(t_int *w)
+static void faustgen_tilde_oversample(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
 {
-    int i, j;
-    llvm_dsp *dsp = (llvm_dsp *)w[1];
-    int const nsamples  = (int)w[2];
-    int const ninputs   = (int)w[3];
-    int const noutputs  = (int)w[4];
-    double** faustsigs  = (double **)w[5];
-    t_sample const** realinputs = (t_sample const**)w[6];
-    t_sample** realoutputs      = (t_sample **)w[7];
-    t_faustgen_tilde *x = (t_faustgen_tilde *)w[8];
-    if (!x->f_active) {
-      // ag: default `active` flag: bypass or mute the dsp
-      if (ninputs == noutputs) {
-	for (i = 0; i < ninputs; ++i) {
-	  for(j = 0; j < nsamples; ++j) {
-	    realoutputs[i][j] = realinputs[i][j];
-	  }
-	}
-      } else {
-	for (i = 0; i < noutputs; ++i) {
-	  for(j = 0; j < nsamples; ++j) {
-	    realoutputs[i][j] = 0.0;
-	  }
-	}
-      }
-      return (w+9);
-    }
-    for(i = 0; i < ninputs; ++i)
+  // ag: Run the dsp at n times the sample rate, 1 turns oversampling off.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av;
+    SETFLOAT(&av, x->f_oversample);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faustgen_tilde_set_oversample(x, (int)argv[0].a_w.w_float);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad oversampling factor '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_set_decimate(t_faustgen_tilde *x, int n)
+{
+    if(n < 1 || n > FAUST_RESAMPLER_MAXFACTOR)
     {
-        for(j = 0; j < nsamples; ++j)
-        {
-            faustsigs[i][j] = (FAUSTFLOAT)realinputs[i][j];
-        }
+        pd_error(x, "faustgen2~: decimation factor must be between 1 and %d", FAUST_RESAMPLER_MAXFACTOR);
+        return;
     }
-    computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
-    for(i = 0; i < noutputs; ++i)
+    if(n != x->f_decimate)
     {
-        for(j = 0; j < nsamples; ++j)
+        // restarting dsp reinitializes the instances at the new sample rate
+        int dspstate = canvas_suspend_dsp();
+        x->f_decimate = n;
+        if(n > 1)
         {
-            realoutputs[i][j] = (t_sample)faustsigs[ninputs+i][j];
+            x->f_oversample = 1;
         }
+        canvas_resume_dsp(dspstate);
     }
-    if (x->f_midiout || x->f_midirecv) {
-      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
-    }
-    if (clock_getsystime() >= x->f_next_tick) {
-      if (x->f_oscout || x->f_oscrecv) {
-	t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
-	faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
-      }
+}
+
+static void faustgen_tilde_decimate(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Run the dsp at 1/n of the sample rate, 1 turns decimation off. The
+  // Pd block size (or internal block size) must be a multiple of n.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av;
+    SETFLOAT(&av, x->f_decimate);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faustgen_tilde_set_decimate(x, (int)argv[0].a_w.w_float);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad decimation factor '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_set_autosleep(t_faustgen_tilde *x, double time, t_sample level)
+{
+    x->f_sleep_time  = time > 0 ? time : 0;
+    x->f_sleep_level = level > 0 ? level : SLEEP_LEVEL;
+    x->f_sleep_tail  = (int)(x->f_sleep_time * x->f_samplerate / 1000.0);
+    x->f_sleep_quiet = 0;
+    x->f_asleep      = false;
+}
+
+static void faustgen_tilde_autosleep(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Auto-sleep, the arguments are the tail time in msecs (0 turns it
+  // off) and the optional silence threshold.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av[2];
+    SETFLOAT(av, x->f_sleep_time);
+    SETFLOAT(av+1, x->f_sleep_level);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 2, av);
+  } else if (argv[0].a_type == A_FLOAT &&
+             (argc == 1 || argv[1].a_type == A_FLOAT)) {
+    faustgen_tilde_set_autosleep(x, argv[0].a_w.w_float,
+                                 argc > 1 ? argv[1].a_w.w_float : x->f_sleep_level);
+  } else {
+    pd_error(x, "faustgen2~: autosleep: bad arguments, expected tail time and threshold");
+  }
+}
+
+static void faustgen_tilde_set_load(t_faustgen_tilde *x, bool f)
+{
+    if(f && !x->f_load)
+    {
+        x->f_load = faust_stats_new();
+    }
+    else if(!f && x->f_load)
+    {
+        faust_stats_free(x->f_load);
+        x->f_load = NULL;
+    }
+}
+
+static void faustgen_tilde_load(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Load meter. Without arguments, output the mean, maximum and the
+  // 50th, 99th and 99.9th percentile of the compute time per block, as a
+  // fraction of the block period, along with the number of blocks measured.
+  // 'load 1' and 'load 0' turn the meter on and off, 'load reset' clears
+  // the statistics.
+  if (argc <= 0) {
+    t_atom av[6];
+    if (!x->f_load) {
+      pd_error(x, "faustgen2~: load meter is off");
+      return;
+    }
+    SETFLOAT(av,   faust_stats_get_mean(x->f_load));
+    SETFLOAT(av+1, faust_stats_get_max(x->f_load));
+    SETFLOAT(av+2, faust_stats_get_percentile(x->f_load, 0.5));
+    SETFLOAT(av+3, faust_stats_get_percentile(x->f_load, 0.99));
+    SETFLOAT(av+4, faust_stats_get_percentile(x->f_load, 0.999));
+    SETFLOAT(av+5, faust_stats_get_count(x->f_load));
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 6, av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faustgen_tilde_set_load(x, argv[0].a_w.w_float != 0);
+  } else if (argv[0].a_type == A_SYMBOL && argv[0].a_w.w_symbol == gensym("reset")) {
+    if (x->f_load)
+      faust_stats_reset(x->f_load);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: load: bad argument '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_bench(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Offline benchmark of the dsp. Runs a temporary instance of the
+  // current factory, starting from the current control values, for the
+  // given number of blocks (1000 by default) on noise input, at the block
+  // size and sample rate at which the perform routine computes the dsp
+  // (taking into account the internal block size, oversampling and the like),
+  // and outputs the time per sample in ns, the real-time factor and the
+  // resulting estimate of the number of instances which could run in real
+  // time. The bench runs on a worker thread, off the audio path, and the
+  // running instance isn't touched. For a polyphonic dsp this measures a
+  // single voice.
+  long const nblocks = argc > 0 && argv[0].a_type == A_FLOAT ? (long)argv[0].a_w.w_float : 1000;
+  int n = x->f_blocksize > 0 ? x->f_blocksize : sys_getblksize();
+  double sr = x->f_samplerate > 0 ? x->f_samplerate : sys_getsr();
+  llvm_dsp *dsp;
+  if (!x->f_dsp_factory) {
+    pd_error(x, "faustgen2~: no dsp instance");
+    return;
+  }
+  if (nblocks <= 0) {
+    pd_error(x, "faustgen2~: bench: bad block count %ld", nblocks);
+    return;
+  }
+  if (x->f_bench && faust_render_busy(x->f_bench)) {
+    pd_error(x, "faustgen2~: bench: still busy with the previous bench");
+    return;
+  }
+  if (x->f_bench) {
+    faust_render_free(x->f_bench);
+    x->f_bench = NULL;
+  }
+  // block size and sample rate at which the dsp runs internally
+  if (x->f_controlrate) {
+    sr /= n;
+    n = 1;
+  } else {
+    // larger internal blocks are buffered, smaller ones split the Pd block
+    if (x->f_iblocksize > 0) n = x->f_iblocksize;
+    if (x->f_decimate > 1 && n % x->f_decimate == 0) {
+      n /= x->f_decimate;
+      sr /= x->f_decimate;
+    } else if (x->f_oversample > 1) {
+      n *= x->f_oversample;
+      sr *= x->f_oversample;
+    }
+  }
+  dsp = createCDSPInstance(x->f_dsp_factory);
+  if (!dsp) {
+    pd_error(x, "faustgen2~: bench: can't create instance");
+    return;
+  }
+  initCDSPInstance(dsp, (int)sr);
+  faust_ui_manager_copy_values(x->f_ui_manager, dsp);
+  x->f_bench = faust_render_bench_new((t_object *)x, dsp, faust_opt_has_double_precision(x->f_opt_manager),
+                                      (int)sr, n, nblocks,
+                                      faust_io_manager_get_extra_output(x->f_io_manager), s);
+}
+
+static void faustgen_tilde_render(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Offline rendering. 'render nsamples out1 out2 ... in in1 in2 ...'
+  // renders nsamples of a fresh instance of the dsp, which starts with the
+  // current control values, into the arrays out1, out2, ..., one for each
+  // output, reading the inputs from the arrays in1, in2, ... if given.
+  // Outputs 'render nsamples msecs' when done. The dsp is run at Pd's sample
+  // rate, without oversampling; for a polyphonic dsp, this renders the first
+  // voice only.
+  int i, nouts;
+  long nsamples;
+  t_symbol **names;
+  llvm_dsp *dsp;
+  t_float const sr = x->f_samplerate > 0 ? x->f_samplerate : sys_getsr();
+  if (!x->f_dsp_instance) {
+    pd_error(x, "faustgen2~: no dsp instance");
+    return;
+  }
+  if (argc < 1 || argv[0].a_type != A_FLOAT || argv[0].a_w.w_float < 1) {
+    pd_error(x, "faustgen2~: render: expected number of samples and array names");
+    return;
+  }
+  if (x->f_render && faust_render_busy(x->f_render)) {
+    pd_error(x, "faustgen2~: render: still busy with the previous render");
+    return;
+  }
+  nsamples = (long)argv[0].a_w.w_float;
+  names = (t_symbol **)getbytes(argc * sizeof(t_symbol *));
+  if (!names) {
+    pd_error(x, "faustgen2~: memory allocation failed - render");
+    return;
+  }
+  for (i = 1, nouts = -1; i < argc; ++i) {
+    if (argv[i].a_type != A_SYMBOL) {
+      pd_error(x, "faustgen2~: render: bad array name");
+      freebytes(names, argc * sizeof(t_symbol *));
+      return;
+    }
+    if (nouts < 0 && argv[i].a_w.w_symbol == gensym("in"))
+      nouts = i - 1;
+    names[i-1] = argv[i].a_w.w_symbol;
+  }
+  if (nouts < 0) nouts = argc - 1;
+  if (x->f_render) {
+    faust_render_free(x->f_render);
+    x->f_render = NULL;
+  }
+  dsp = createCDSPInstance(x->f_dsp_factory);
+  if (!dsp) {
+    pd_error(x, "faustgen2~: render: can't create instance");
+  } else {
+    initCDSPInstance(dsp, (int)sr);
+    faust_ui_manager_copy_values(x->f_ui_manager, dsp);
+    // skip the 'in' keyword for the input arrays
+    int const nins = nouts < argc - 1 ? argc - nouts - 2 : 0;
+    x->f_render = faust_render_new((t_object *)x, dsp, faust_opt_has_double_precision(x->f_opt_manager),
+                                   nsamples, nouts, names, nins, names + nouts + 1,
+                                   faust_io_manager_get_extra_output(x->f_io_manager), s);
+  }
+  freebytes(names, argc * sizeof(t_symbol *));
+}
+
+static void faustgen_tilde_perfcount(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Hardware performance counters of the compute calls (Linux only).
+  // Without arguments, output the cycles, instructions, cache misses and
+  // branch misses per sample (at the dsp's internal sample rate, -1 if a
+  // counter isn't available), along with the number of samples measured.
+  // 'perfcount 1' and 'perfcount 0' turn counting on and off, 'perfcount
+  // reset' clears the counts.
+  if (argc <= 0) {
+    int i;
+    t_atom av[FAUST_PERF_NCOUNTERS+1];
+    if (!x->f_perf) {
+      pd_error(x, "faustgen2~: perfcount is off");
+      return;
+    }
+    for (i = 0; i < FAUST_PERF_NCOUNTERS; ++i)
+      SETFLOAT(av+i, faust_perf_get(x->f_perf, i));
+    SETFLOAT(av+i, faust_perf_get_samples(x->f_perf));
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, FAUST_PERF_NCOUNTERS+1, av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    if (argv[0].a_w.w_float != 0 && !x->f_perf) {
+      x->f_perf = faust_perf_new();
+      if (!x->f_perf)
+        pd_error(x, "faustgen2~: perfcount: performance counters not available (%s)", strerror(errno));
+    } else if (argv[0].a_w.w_float == 0 && x->f_perf) {
+      faust_perf_free(x->f_perf);
+      x->f_perf = NULL;
+    }
+  } else if (argv[0].a_type == A_SYMBOL && argv[0].a_w.w_symbol == gensym("reset")) {
+    if (x->f_perf)
+      faust_perf_reset(x->f_perf);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: perfcount: bad argument '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_stats(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Global statistics, usually sent to all objects through the global
+  // faustgen2~ receiver. 'stats receiver' sends the statistics of each dsp
+  // to the given receiver, 'stats' prints them. 'stats 1' and 'stats 0' turn
+  // collecting the compute times on and off, 'stats reset' clears them.
+  if (argc <= 0) {
+    faust_stats_registry_query(NULL);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faust_stats_registry_enable(argv[0].a_w.w_float != 0);
+  } else if (argv[0].a_type == A_SYMBOL && argv[0].a_w.w_symbol == gensym("reset")) {
+    faust_stats_registry_reset();
+  } else if (argv[0].a_type == A_SYMBOL) {
+    faust_stats_registry_query(argv[0].a_w.w_symbol);
+  } else {
+    pd_error(x, "faustgen2~: stats: bad argument");
+  }
+}
+
+static void faustgen_tilde_trace(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Tracing of compiles and perform routines, usually sent to all
+  // objects through the global faustgen2~ receiver. 'trace 1' and 'trace 0'
+  // turn tracing on and off, 'trace filename' writes the recorded events as
+  // a Chrome trace-event file, relative to the patch directory. The events
+  // are kept after 'trace 0' until the next 'trace 1', 'trace free' discards
+  // them.
+  if (argc > 0 && argv[0].a_type == A_FLOAT) {
+    faust_trace_enable(argv[0].a_w.w_float != 0);
+  } else if (argc > 0 && argv[0].a_type == A_SYMBOL && argv[0].a_w.w_symbol == gensym("free")) {
+    faust_trace_free();
+  } else if (argc > 0 && argv[0].a_type == A_SYMBOL) {
+    char buf[MAXPDSTRING];
+    canvas_makefilename(x->f_canvas, argv[0].a_w.w_symbol->s_name, buf, MAXPDSTRING);
+    faust_trace_write(buf);
+  } else {
+    pd_error(x, "faustgen2~: trace: expected on/off flag or file name");
+  }
+}
+
+// Number of the list parameter 'prefix<i>' in the list message, i.e., the
+// number of consecutively numbered controls starting at the first one.
+static int faustgen_tilde_ctlbench_list(t_faustgen_tilde *x, t_symbol **names, size_t n,
+                                        t_symbol **prefix, int *start)
+{
+  size_t i;
+  for (i = 0; i < n; ++i) {
+    char const* name = names[i]->s_name;
+    char const* digits = name + strlen(name);
+    while (digits > name && isdigit((unsigned char)digits[-1])) --digits;
+    if (*digits && digits > name && (size_t)(digits - name) < MAXFAUSTSTRING) {
+      char buf[MAXFAUSTSTRING];
+      t_float value;
+      int m = 0;
+      snprintf(buf, MAXFAUSTSTRING, "%.*s", (int)(digits - name), name);
+      *prefix = gensym(buf);
+      *start = atoi(digits);
+      do {
+        snprintf(buf, MAXFAUSTSTRING, "%s%i", (*prefix)->s_name, *start + m);
+      } while (!faust_ui_manager_get_value(x->f_ui_manager, gensym(buf), &value) && (size_t)++m < n);
+      return m;
+    }
+  }
+  return 0;
+}
+
+static void faustgen_tilde_ctlbench(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Benchmark of the control message path. Sends the given number of
+  // messages (100000 by default) of each kind to the object, cycling
+  // through the controls, and outputs the number of controls along
+  // with the time per message in ns for setting controls by name, by MIDI
+  // ctl and by OSC, and the time per value for setting numbered controls
+  // with a list message ('name start values...'). Kinds of messages which
+  // the dsp doesn't bind report 0. All messages resend the current values,
+  // mapped to the ranges of the MIDI and OSC bindings, so that a running dsp
+  // is hardly disturbed (MIDI values are quantized to 7 bits, though, and
+  // controls sharing a controller or address get each other's values in the
+  // meantime). The control values are restored after. The messages take
+  // the same path as messages from the patch (class dispatch, event
+  // timestamps and queueing in accurate mode, waking up a sleeping dsp), so
+  // the times include all of that.
+  long count = argc > 0 && argv[0].a_type == A_FLOAT ? (long)argv[0].a_w.w_float : 100000;
+  size_t i, n, nmidi = 0, nosc = 0;
+  long k;
+  t_symbol **names, **osc, *prefix = NULL;
+  int *midictl, start = 0, nlist;
+  t_float *values, *midival, *oscval;
+  t_atom *av, res[5];
+  double time, elapsed[4] = {0, 0, 0, 0};
+  if (!x->f_dsp_instance) {
+    pd_error(x, "faustgen2~: no dsp instance");
+    return;
+  }
+  if (count <= 0) {
+    pd_error(x, "faustgen2~: ctlbench: bad message count %ld", count);
+    return;
+  }
+  n = faust_ui_manager_get_controls(x->f_ui_manager, NULL, NULL, NULL, 0);
+  if (!n) {
+    pd_error(x, "faustgen2~: ctlbench: dsp has no controls");
+    return;
+  }
+  names = (t_symbol **)getbytes(n * sizeof(t_symbol *));
+  osc = (t_symbol **)getbytes(n * sizeof(t_symbol *));
+  midictl = (int *)getbytes(n * sizeof(int));
+  values = (t_float *)getbytes(n * sizeof(t_float));
+  midival = (t_float *)getbytes(n * sizeof(t_float));
+  oscval = (t_float *)getbytes(n * sizeof(t_float));
+  av = (t_atom *)getbytes((n + 1) * sizeof(t_atom));
+  if (!names || !osc || !midictl || !values || !midival || !oscval || !av) {
+    pd_error(x, "faustgen2~: memory allocation failed - ctlbench");
+    goto done;
+  }
+  faust_ui_manager_get_controls(x->f_ui_manager, names, midictl, osc, n);
+  faust_ui_manager_get_bound_values(x->f_ui_manager, midival, oscval, n);
+  for (i = 0; i < n; ++i) {
+    faust_ui_manager_get_value(x->f_ui_manager, names[i], values + i);
+    nmidi += midictl[i] >= 0;
+    nosc += osc[i] != NULL;
+  }
+  // set by name, using the current values so that the dsp isn't disturbed
+  time = faust_stats_gettime();
+  for (k = 0; k < count; ++k) {
+    i = (size_t)k % n;
+    SETFLOAT(av, values[i]);
+    pd_typedmess((t_pd *)x, names[i], 1, av);
+  }
+  elapsed[0] = (faust_stats_gettime() - time) * 1e9 / count;
+  if (nmidi) {
+    time = faust_stats_gettime();
+    for (k = 0, i = 0; k < count; ++k) {
+      while (midictl[i % n] < 0) ++i;
+      SETFLOAT(av, midival[i % n]);
+      SETFLOAT(av+1, midictl[i++ % n]);
+      pd_typedmess((t_pd *)x, gensym("ctl"), 2, av);
+    }
+    elapsed[1] = (faust_stats_gettime() - time) * 1e9 / count;
+  }
+  if (nosc) {
+    time = faust_stats_gettime();
+    for (k = 0, i = 0; k < count; ++k) {
+      while (!osc[i % n]) ++i;
+      SETFLOAT(av, oscval[i % n]);
+      pd_typedmess((t_pd *)x, osc[i++ % n], 1, av);
+    }
+    elapsed[2] = (faust_stats_gettime() - time) * 1e9 / count;
+  }
+  nlist = faustgen_tilde_ctlbench_list(x, names, n, &prefix, &start);
+  if (nlist > 1) {
+    long const nmsgs = (count + nlist - 1) / nlist;
+    SETFLOAT(av, start);
+    for (i = 0; i < (size_t)nlist; ++i) {
+      char buf[MAXFAUSTSTRING];
+      t_float value = 0;
+      snprintf(buf, MAXFAUSTSTRING, "%s%i", prefix->s_name, start + (int)i);
+      faust_ui_manager_get_value(x->f_ui_manager, gensym(buf), &value);
+      SETFLOAT(av+i+1, value);
+    }
+    time = faust_stats_gettime();
+    for (k = 0; k < nmsgs; ++k) {
+      pd_typedmess((t_pd *)x, prefix, nlist + 1, av);
+    }
+    elapsed[3] = (faust_stats_gettime() - time) * 1e9 / ((double)nmsgs * nlist);
+  }
+  for (i = 0; i < n; ++i) {
+    faust_ui_manager_set_value(x->f_ui_manager, names[i], values[i]);
+  }
+  logpost(x, 3, "faustgen2~: %s: %lu controls, %ld messages: name %.1f ns, midi %.1f ns, osc %.1f ns, list %.1f ns/value",
+          x->f_dsp_name->s_name, (unsigned long)n, count, elapsed[0], elapsed[1], elapsed[2], elapsed[3]);
+  SETFLOAT(res, n);
+  for (k = 0; k < 4; ++k) {
+    SETFLOAT(res+k+1, elapsed[k]);
+  }
+  outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 5, res);
+done:
+  if (names) freebytes(names, n * sizeof(t_symbol *));
+  if (osc) freebytes(osc, n * sizeof(t_symbol *));
+  if (midictl) freebytes(midictl, n * sizeof(int));
+  if (values) freebytes(values, n * sizeof(t_float));
+  if (midival) freebytes(midival, n * sizeof(t_float));
+  if (oscval) freebytes(oscval, n * sizeof(t_float));
+  if (av) freebytes(av, (n + 1) * sizeof(t_atom));
+}
+
+static void faustgen_tilde_set_blocksize(t_faustgen_tilde *x, int n)
+{
+    if(n < 0)
+    {
+        pd_error(x, "faustgen2~: bad block size %d", n);
+        return;
+    }
+    if(n != x->f_iblocksize)
+    {
+        // restarting dsp sets up the fifo for the new block size
+        int dspstate = canvas_suspend_dsp();
+        x->f_iblocksize = n;
+        canvas_resume_dsp(dspstate);
+    }
+}
+
+static void faustgen_tilde_blocksize(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Internal block size of the dsp, 0 means Pd's block size. Larger
+  // sizes are buffered (adding latency), smaller ones split the Pd block.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av;
+    SETFLOAT(&av, x->f_iblocksize);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faustgen_tilde_set_blocksize(x, (int)argv[0].a_w.w_float);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad block size '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_set_controlrate(t_faustgen_tilde *x, bool on)
+{
+    if(on != x->f_controlrate)
+    {
+        // restarting dsp reinitializes the instances at the new sample rate
+        int dspstate = canvas_suspend_dsp();
+        x->f_controlrate = on;
+        canvas_resume_dsp(dspstate);
+    }
+}
+
+static void faustgen_tilde_controlrate(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: Control-rate mode, for dsps which are only used for their passive
+  // controls (LFOs, envelope followers, etc.), 0 turns it off.
+  if (argc <= 0) {
+    // output the current status
+    t_atom av;
+    SETFLOAT(&av, x->f_controlrate);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+  } else if (argv[0].a_type == A_FLOAT) {
+    faustgen_tilde_set_controlrate(x, argv[0].a_w.w_float != 0);
+  } else {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad control-rate flag '%s'", buf);
+  }
+}
+
+static void faustgen_tilde_latency(t_faustgen_tilde *x)
+{
+  // ag: Report the current latency of the object in samples, which is due
+  // to the fifo of a large internal block size and the resampling filters.
+  t_atom av;
+  int latency = x->f_fifo_latency;
+  if (x->f_resampler)
+    latency += x->f_decimate > 1 ? faust_resampler_get_latency(x->f_decimate, 1) :
+      faust_resampler_get_latency(x->f_oversample, 0);
+  SETFLOAT(&av, latency);
+  outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), gensym("latency"), 1, &av);
+}
+
+static void faustgen_tilde_instance(t_faustgen_tilde *x, t_symbol* s, int argc, t_atom* argv)
+{
+  // ag: In ganged mode, select the instance which parameter messages are
+  // sent to (1-based, 0 means all instances). Extra arguments are taken to
+  // be a parameter message for just that instance, which leaves the current
+  // selection alone.
+  size_t k, prev;
+  if (!x->f_gang || !x->f_ninstances) {
+    pd_error(x, "faustgen2~: instance: not in ganged mode");
+    return;
+  }
+  prev = faust_ui_manager_get_instance(x->f_ui_manager);
+  if (argc <= 0) {
+    // output the current selection
+    t_atom av;
+    SETFLOAT(&av, prev);
+    outlet_anything(faust_io_manager_get_extra_output(x->f_io_manager), s, 1, &av);
+    return;
+  }
+  if (argv[0].a_type != A_FLOAT || argv[0].a_w.w_float < 0 ||
+      faust_ui_manager_set_instance(x->f_ui_manager,
+                                    k = (size_t)argv[0].a_w.w_float)) {
+    char buf[MAXPDSTRING];
+    atom_string(&argv[0], buf, MAXPDSTRING);
+    pd_error(x, "faustgen2~: bad instance number '%s'", buf);
+    return;
+  }
+  if (argc > 1) {
+    if (argv[1].a_type != A_SYMBOL) {
+      pd_error(x, "faustgen2~: instance: parameter name expected");
+    } else {
+      faustgen_tilde_anything(x, argv[1].a_w.w_symbol, argc-2, argv+2);
+    }
+    faust_ui_manager_set_instance(x->f_ui_manager, prev);
+  }
+}
+
+// Voices which have been released are put to sleep as soon as their output
+// stays below this level for an entire block (about -66 dB, like the
+// VOICE_STOP_LEVEL in Faust's poly-dsp.h).
+#define VOICE_STOP_LEVEL 0.0005
+
+// Add the outputs of a voice to the mix, or just copy them if it's the first
+// voice, and return the peak level of the voice outputs.
+static double faustgen_tilde_mix_single(float** mix, float** vouts, size_t nchans, int nsamples, bool first)
+{
+    size_t i;
+    int j;
+    double level = 0.0;
+    for(i = 0; i < nchans; ++i)
+    {
+        float* out = mix[i];
+        float const* in = vouts[i];
+        float peak = 0.0f;
+        if(first)
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] = in[j];
+                peak = fmaxf(peak, fabsf(in[j]));
+            }
+        }
+        else
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] += in[j];
+                peak = fmaxf(peak, fabsf(in[j]));
+            }
+        }
+        if(peak > level)
+        {
+            level = peak;
+        }
+    }
+    return level;
+}
+
+static double faustgen_tilde_mix_double(double** mix, double** vouts, size_t nchans, int nsamples, bool first)
+{
+    size_t i;
+    int j;
+    double level = 0.0;
+    for(i = 0; i < nchans; ++i)
+    {
+        double* out = mix[i];
+        double const* in = vouts[i];
+        double peak = 0.0;
+        if(first)
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] = in[j];
+                peak = fmax(peak, fabs(in[j]));
+            }
+        }
+        else
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] += in[j];
+                peak = fmax(peak, fabs(in[j]));
+            }
+        }
+        if(peak > level)
+        {
+            level = peak;
+        }
+    }
+    return level;
+}
+
+// Compute a block of samples. The signal matrix holds the Faust input and
+// output buffers, followed by the scratch buffers for the voice outputs and
+// the voice mix (multi-instance polyphony only).
+static void faustgen_tilde_compute_instances(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs, void** faustsigs, bool isdbl)
+{
+    size_t i, k;
+    bool first = true;
+    void** vouts;
+    void** mix;
+    if(!x->f_ninstances)
+    {
+        computeCDSPInstance(dsp, nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)(faustsigs+ninputs));
+        return;
+    }
+    vouts = faustsigs + ninputs + noutputs;
+    mix   = x->f_effect_instance ? vouts + x->f_voice_noutputs : faustsigs + ninputs;
+    faust_ui_manager_sync_instances(x->f_ui_manager);
+    for(k = 0; k < x->f_ninstances; ++k)
+    {
+        double level;
+        int const state = faust_ui_manager_voice_state(x->f_ui_manager, k);
+        if(state == STATE_IDLE)
+        {
+            // idle voice, nothing to do
+            continue;
+        }
+        computeCDSPInstance(x->f_instances[k], nsamples, (FAUSTFLOAT**)faustsigs, (FAUSTFLOAT**)vouts);
+        if(isdbl)
+        {
+            level = faustgen_tilde_mix_double((double**)mix, (double**)vouts, x->f_voice_noutputs, nsamples, first);
+        }
+        else
+        {
+            level = faustgen_tilde_mix_single((float**)mix, (float**)vouts, x->f_voice_noutputs, nsamples, first);
+        }
+        first = false;
+        if(state == STATE_RELEASE && level < VOICE_STOP_LEVEL)
+        {
+            faust_ui_manager_voice_sleep(x->f_ui_manager, k);
+        }
+    }
+    if(first)
+    {
+        // all voices are asleep
+        for(i = 0; i < x->f_voice_noutputs; ++i)
+        {
+            memset(mix[i], 0, nsamples * (isdbl ? sizeof(double) : sizeof(float)));
+        }
+    }
+    if(x->f_effect_instance)
+    {
+        computeCDSPInstance(x->f_effect_instance, nsamples, (FAUSTFLOAT**)mix, (FAUSTFLOAT**)(faustsigs+ninputs));
+    }
+}
+
+static void faustgen_tilde_compute(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs, void** faustsigs, bool isdbl)
+{
+    if(x->f_perf)
+    {
+        faust_perf_start(x->f_perf);
+        faustgen_tilde_compute_instances(x, dsp, nsamples, ninputs, noutputs, faustsigs, isdbl);
+        faust_perf_stop(x->f_perf, nsamples);
+        return;
+    }
+    faustgen_tilde_compute_instances(x, dsp, nsamples, ninputs, noutputs, faustsigs, isdbl);
+}
+
+// Copy the Faust outputs to Pd's output vectors (ganged mode).
+static void faustgen_tilde_copy_outputs(t_sample** realoutputs, void** faustouts, int nchans, int offset, int nsamples, bool isdbl)
+{
+    int i, j;
+    for(i = 0; i < nchans; ++i)
+    {
+        t_sample* out = realoutputs[i] + offset;
+        if(isdbl)
+        {
+            double const* in = (double const*)faustouts[i];
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] = (t_sample)in[j];
+            }
+        }
+        else
+        {
+            float const* in = (float const*)faustouts[i];
+            for(j = 0; j < nsamples; ++j)
+            {
+                out[j] = (t_sample)in[j];
+            }
+        }
+    }
+}
+
+// Compute the samples [offset, offset+nsamples) of the current block.
+// With oversampling or decimation, the inputs are resampled into the
+// resampler's buffers, the dsp is computed at its own rate there, and the
+// outputs are resampled back into the signal matrix.
+static void faustgen_tilde_compute_range(t_faustgen_tilde *x, llvm_dsp *dsp, int offset, int nsamples, int ninputs, int noutputs,
+                                         void** faustsigs, t_sample** realoutputs, bool isdbl)
+{
+    size_t i;
+    void** sigs;
+    int n = nsamples;
+    if(offset)
+    {
+        size_t const size = isdbl ? sizeof(double) : sizeof(float);
+        for(i = 0; i < x->f_nsignals; ++i)
+        {
+            x->f_signal_offsets[i] = (char*)faustsigs[i] + offset * size;
+        }
+        faustsigs = x->f_signal_offsets;
+    }
+    sigs = faustsigs;
+    if(x->f_resampler)
+    {
+        sigs = faust_resampler_get_signals(x->f_resampler);
+        n = faust_resampler_get_nsamples(x->f_resampler, nsamples);
+        faust_resampler_process_inputs(x->f_resampler, faustsigs, (size_t)ninputs, nsamples);
+    }
+    if(x->f_gang && x->f_ninstances)
+    {
+        // ganged mode: the instances are computed back-to-back, all sharing
+        // the same output buffers (the inputs have all been copied before,
+        // since Pd may reuse an input vector for some output)
+        int const nins  = ninputs / (int)x->f_ninstances;
+        int const nouts = noutputs / (int)x->f_ninstances;
+        faust_ui_manager_sync_instances(x->f_ui_manager);
+        for(i = 0; i < x->f_ninstances; ++i)
+        {
+            computeCDSPInstance(x->f_instances[i], n, (FAUSTFLOAT**)(sigs+i*nins), (FAUSTFLOAT**)(sigs+ninputs));
+            if(x->f_resampler)
+            {
+                faust_resampler_process_outputs(x->f_resampler, i*nouts, faustsigs+ninputs, (size_t)nouts, nsamples);
+            }
+            faustgen_tilde_copy_outputs(realoutputs+i*nouts, faustsigs+ninputs, nouts, offset, nsamples, isdbl);
+        }
+    }
+    else
+    {
+        faustgen_tilde_compute(x, dsp, n, ninputs, noutputs, sigs, isdbl);
+        if(x->f_resampler)
+        {
+            faust_resampler_process_outputs(x->f_resampler, 0, faustsigs+ninputs, (size_t)noutputs, nsamples);
+        }
+    }
+}
+
+// Compute a block of samples. With sample-accurate timing, pending events
+// split the block into sub-blocks, so that each control change takes effect
+// at its sample offset, rounded down to a multiple of the minimum sub-block
+// size. With an internal block size smaller than the Pd block size, the
+// block is also computed in chunks of that size. With decimation, all
+// sub-blocks have to be multiples of the decimation factor.
+static void faustgen_tilde_process(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs,
+                                   void** faustsigs, t_sample** realoutputs, bool isdbl)
+{
+    int offset = 0, next;
+    int const grain = x->f_resampler && x->f_decimate > 1 ? x->f_decimate : 1;
+    int const quantum = x->f_accurate > grain ? x->f_accurate + (grain - x->f_accurate % grain) % grain : grain;
+    int const chunk = x->f_iblocksize > 0 && x->f_iblocksize < nsamples ? x->f_iblocksize : nsamples;
+    while(offset < nsamples)
+    {
+        int const end = nsamples - offset > chunk ? offset + chunk : nsamples;
+        while((next = faust_ui_manager_next_event(x->f_ui_manager)) >= 0)
+        {
+            next -= next % quantum;
+            if(next >= end)
+            {
+                // the event belongs to a later chunk or block
+                break;
+            }
+            if(next > offset)
+            {
+                faustgen_tilde_compute_range(x, dsp, offset, next - offset, ninputs, noutputs, faustsigs, realoutputs, isdbl);
+                offset = next;
+            }
+            faust_ui_manager_apply_events(x->f_ui_manager, offset + quantum <= end ? offset + quantum - 1 : end - 1);
+        }
+        faustgen_tilde_compute_range(x, dsp, offset, end - offset, ninputs, noutputs, faustsigs, realoutputs, isdbl);
+        offset = end;
+    }
+    // the remaining events belong to the next block
+    faust_ui_manager_shift_events(x->f_ui_manager, nsamples);
+}
+
+// Compute a block of samples from the Faust inputs in the signal matrix and
+// store the results in the given output vectors.
+static void faustgen_tilde_run(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs,
+                               void** faustsigs, t_sample** outputs, bool isdbl)
+{
+    faustgen_tilde_process(x, dsp, nsamples, ninputs, noutputs, faustsigs, outputs, isdbl);
+    if(!(x->f_gang && x->f_ninstances))
+    {
+        faustgen_tilde_copy_outputs(outputs, faustsigs+ninputs, noutputs, 0, nsamples, isdbl);
+    }
+}
+
+// Run the dsp in control-rate mode, computing a single sample per Pd block.
+// The inputs are sampled at the beginning of the block, and the outputs are
+// held for the entire block.
+static void faustgen_tilde_perform_control(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs,
+                                           void** faustsigs, t_sample const** realinputs, t_sample** realoutputs, bool isdbl)
+{
+    int i, j;
+    for(i = 0; i < ninputs; ++i)
+    {
+        if(isdbl)
+        {
+            ((double*)faustsigs[i])[0] = (double)realinputs[i][0];
+        }
+        else
+        {
+            ((float*)faustsigs[i])[0] = (float)realinputs[i][0];
+        }
+    }
+    faustgen_tilde_run(x, dsp, 1, ninputs, noutputs, faustsigs, realoutputs, isdbl);
+    for(i = 0; i < noutputs; ++i)
+    {
+        t_sample const v = realoutputs[i][0];
+        for(j = 1; j < nsamples; ++j)
+        {
+            realoutputs[i][j] = v;
+        }
+    }
+}
+
+// Run the dsp at an internal block size larger than the Pd block size. The
+// inputs are collected in the signal matrix until a full internal block is
+// available, and the outputs are delayed by f_fifo_latency samples, which
+// is just enough to never run out of samples. Returns true if any internal
+// block was computed.
+static bool faustgen_tilde_perform_fifo(t_faustgen_tilde *x, llvm_dsp *dsp, int nsamples, int ninputs, int noutputs,
+                                        void** faustsigs, t_sample const** realinputs, t_sample** realoutputs, bool isdbl)
+{
+    int i, j, pos = 0;
+    bool computed = false;
+    int const size = x->f_fifo_size;
+    while(pos < nsamples)
+    {
+        int const n = nsamples - pos < size - x->f_fifo_fill ? nsamples - pos : size - x->f_fifo_fill;
+        for(i = 0; i < ninputs; ++i)
+        {
+            t_sample const* in = realinputs[i] + pos;
+            if(isdbl)
+            {
+                double* out = (double*)faustsigs[i] + x->f_fifo_fill;
+                for(j = 0; j < n; ++j)
+                {
+                    out[j] = (double)in[j];
+                }
+            }
+            else
+            {
+                float* out = (float*)faustsigs[i] + x->f_fifo_fill;
+                for(j = 0; j < n; ++j)
+                {
+                    out[j] = (float)in[j];
+                }
+            }
+        }
+        x->f_fifo_fill += n;
+        pos += n;
+        if(x->f_fifo_fill == size)
+        {
+            for(i = 0; i < noutputs; ++i)
+            {
+                x->f_fifo_ptrs[i] = x->f_fifo_outputs[i] + x->f_fifo_count;
+            }
+            faustgen_tilde_run(x, dsp, size, ninputs, noutputs, faustsigs, x->f_fifo_ptrs, isdbl);
+            x->f_fifo_count += size;
+            x->f_fifo_fill = 0;
+            computed = true;
+        }
+    }
+    for(i = 0; i < noutputs; ++i)
+    {
+        memcpy(realoutputs[i], x->f_fifo_outputs[i], nsamples * sizeof(t_sample));
+        memmove(x->f_fifo_outputs[i], x->f_fifo_outputs[i] + nsamples, (x->f_fifo_count - nsamples) * sizeof(t_sample));
+    }
+    x->f_fifo_count -= nsamples;
+    return computed;
+}
+
+// ag: Silence detection for auto-sleep. The check is a branch-free
+// reduction, so that the compiler can vectorize it.
+static bool faustgen_tilde_is_silent(t_sample const** sigs, int nchans, int nsamples, t_sample level)
+{
+    int i, j;
+    int loud = 0;
+    for(i = 0; i < nchans; ++i)
+    {
+        t_sample const* vec = sigs[i];
+        for(j = 0; j < nsamples; ++j)
+        {
+            loud |= (vec[j] > level) | (vec[j] < -level);
+        }
+    }
+    return !loud;
+}
+
+// Check whether a sleeping dsp can keep sleeping, i.e., its inputs are
+// still silent and no message has arrived in the meantime.
+static bool faustgen_tilde_sleeping(t_faustgen_tilde *x, bool silent)
+{
+    if(x->f_asleep && silent && !x->f_wakeup)
+    {
+        x->f_sleep_skipped++;
+        return true;
+    }
+    x->f_asleep = false;
+    if(x->f_wakeup)
+    {
+        x->f_sleep_quiet = 0;
+        x->f_wakeup = false;
+    }
+    return false;
+}
+
+// Put the dsp to sleep once its outputs have stayed silent for the tail
+// time (while the inputs were silent, too).
+static void faustgen_tilde_update_sleep(t_faustgen_tilde *x, t_sample** outputs, int noutputs, int nsamples)
+{
+    if(faustgen_tilde_is_silent((t_sample const**)outputs, noutputs, nsamples, x->f_sleep_level))
+    {
+        x->f_sleep_quiet += nsamples;
+        if(x->f_sleep_quiet >= x->f_sleep_tail)
+        {
+            x->f_asleep = true;
+        }
+    }
+    else
+    {
+        x->f_sleep_quiet = 0;
+    }
+}
+
+static t_int *faustgen_tilde_perform_single(t_int *w)
+{
+    int i, j;
+    bool silent, timed, computed = true;
+    double start = 0;
+    llvm_dsp *dsp = (llvm_dsp *)w[1];
+    int const nsamples  = (int)w[2];
+    int const ninputs   = (int)w[3];
+    int const noutputs  = (int)w[4];
+    float** faustsigs   = (float **)w[5];
+    t_sample const** realinputs = (t_sample const**)w[6];
+    t_sample** realoutputs      = (t_sample **)w[7];
+    t_faustgen_tilde *x = (t_faustgen_tilde *)w[8];
+    if (!x->f_active) {
+      // ag: default `active` flag: bypass or mute the dsp
+      if (ninputs == noutputs) {
+	for (i = 0; i < ninputs; ++i) {
+	  for(j = 0; j < nsamples; ++j) {
+	    realoutputs[i][j] = realinputs[i][j];
+	  }
+	}
+      } else {
+	for (i = 0; i < noutputs; ++i) {
+	  for(j = 0; j < nsamples; ++j) {
+	    realoutputs[i][j] = 0.0;
+	  }
+	}
+      }
+      faust_ui_manager_apply_events(x->f_ui_manager, -1);
+      x->f_tick_time = clock_getlogicaltime();
+      return (w+9);
+    }
+    x->f_tick_time = clock_getlogicaltime();
+    // ag: auto-sleep only makes sense for a dsp with outputs
+    silent = x->f_sleep_time > 0 && noutputs > 0 &&
+        faustgen_tilde_is_silent(realinputs, ninputs, nsamples, x->f_sleep_level);
+    if(faustgen_tilde_sleeping(x, silent))
+    {
+        for(i = 0; i < noutputs; ++i)
+        {
+            memset(realoutputs[i], 0, nsamples * sizeof(t_sample));
+        }
+        return (w+9);
+    }
+    timed = x->f_load || faust_stats_registry_enabled() || faust_trace_enabled();
+    if(timed)
+    {
+        start = faust_stats_gettime();
+    }
+    if(x->f_controlrate)
+    {
+        faustgen_tilde_perform_control(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realinputs, realoutputs, false);
+    }
+    else if(x->f_fifo_size)
+    {
+        computed = faustgen_tilde_perform_fifo(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realinputs, realoutputs, false);
+    }
+    else
+    {
+        for(i = 0; i < ninputs; ++i)
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                faustsigs[i][j] = (float)realinputs[i][j];
+            }
+        }
+        faustgen_tilde_run(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realoutputs, false);
+    }
+    if(timed)
+    {
+        double const elapsed = faust_stats_gettime() - start;
+        faust_stats_registry_time(x->f_stats, elapsed);
+        faust_trace_end("perform", "dsp", x->f_dsp_name, start);
+        if(x->f_load)
+        {
+            faust_stats_add(x->f_load, elapsed * x->f_samplerate / nsamples);
+        }
+    }
+    if(silent)
+    {
+        faustgen_tilde_update_sleep(x, realoutputs, noutputs, nsamples);
+    }
+    else
+    {
+        x->f_sleep_quiet = 0;
+    }
+    if(!computed)
+    {
+        // ag: control output is only needed when the dsp actually ran
+        return (w+9);
+    }
+    if (x->f_midiout || x->f_midirecv) {
+      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
+    }
+    if (clock_getsystime() >= x->f_next_tick) {
+      if (x->f_oscout || x->f_oscrecv) {
+	t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+	faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
+      }
+      if (x->f_instance_name && x->f_instance_name->s_thing)
+	faust_ui_manager_gui_update(x->f_ui_manager);
+      x->f_next_tick = clock_getsystimeafter(gui_update_time);
+    }
+    return (w+9);
+}
+
+static t_int *faustgen_tilde_perform_double(t_int *w)
+{
+    int i, j;
+    bool silent, timed, computed = true;
+    double start = 0;
+    llvm_dsp *dsp = (llvm_dsp *)w[1];
+    int const nsamples  = (int)w[2];
+    int const ninputs   = (int)w[3];
+    int const noutputs  = (int)w[4];
+    double** faustsigs  = (double **)w[5];
+    t_sample const** realinputs = (t_sample const**)w[6];
+    t_sample** realoutputs      = (t_sample **)w[7];
+    t_faustgen_tilde *x = (t_faustgen_tilde *)w[8];
+    if (!x->f_active) {
+      // ag: default `active` flag: bypass or mute the dsp
+      if (ninputs == noutputs) {
+	for (i = 0; i < ninputs; ++i) {
+	  for(j = 0; j < nsamples; ++j) {
+	    realoutputs[i][j] = realinputs[i][j];
+	  }
+	}
+      } else {
+	for (i = 0; i < noutputs; ++i) {
+	  for(j = 0; j < nsamples; ++j) {
+	    realoutputs[i][j] = 0.0;
+	  }
+	}
+      }
+      faust_ui_manager_apply_events(x->f_ui_manager, -1);
+      x->f_tick_time = clock_getlogicaltime();
+      return (w+9);
+    }
+    x->f_tick_time = clock_getlogicaltime();
+    // ag: auto-sleep only makes sense for a dsp with outputs
+    silent = x->f_sleep_time > 0 && noutputs > 0 &&
+        faustgen_tilde_is_silent(realinputs, ninputs, nsamples, x->f_sleep_level);
+    if(faustgen_tilde_sleeping(x, silent))
+    {
+        for(i = 0; i < noutputs; ++i)
+        {
+            memset(realoutputs[i], 0, nsamples * sizeof(t_sample));
+        }
+        return (w+9);
+    }
+    timed = x->f_load || faust_stats_registry_enabled() || faust_trace_enabled();
+    if(timed)
+    {
+        start = faust_stats_gettime();
+    }
+    if(x->f_controlrate)
+    {
+        faustgen_tilde_perform_control(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realinputs, realoutputs, true);
+    }
+    else if(x->f_fifo_size)
+    {
+        computed = faustgen_tilde_perform_fifo(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realinputs, realoutputs, true);
+    }
+    else
+    {
+        for(i = 0; i < ninputs; ++i)
+        {
+            for(j = 0; j < nsamples; ++j)
+            {
+                faustsigs[i][j] = (double)realinputs[i][j];
+            }
+        }
+        faustgen_tilde_run(x, dsp, nsamples, ninputs, noutputs, (void**)faustsigs, realoutputs, true);
+    }
+    if(timed)
+    {
+        double const elapsed = faust_stats_gettime() - start;
+        faust_stats_registry_time(x->f_stats, elapsed);
+        faust_trace_end("perform", "dsp", x->f_dsp_name, start);
+        if(x->f_load)
+        {
+            faust_stats_add(x->f_load, elapsed * x->f_samplerate / nsamples);
+        }
+    }
+    if(silent)
+    {
+        faustgen_tilde_update_sleep(x, realoutputs, noutputs, nsamples);
+    }
+    else
+    {
+        x->f_sleep_quiet = 0;
+    }
+    if(!computed)
+    {
+        // ag: control output is only needed when the dsp actually ran
+        return (w+9);
+    }
+    if (x->f_midiout || x->f_midirecv) {
+      t_outlet *out = x->f_midiout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+      faust_ui_manager_midiout(x->f_ui_manager, x->f_midichan, x->f_midirecv, out);
+    }
+    if (clock_getsystime() >= x->f_next_tick) {
+      if (x->f_oscout || x->f_oscrecv) {
+	t_outlet *out = x->f_oscout?faust_io_manager_get_extra_output(x->f_io_manager):NULL;
+	faust_ui_manager_oscout(x->f_ui_manager, x->f_oscrecv, out);
+      }
       if (x->f_instance_name && x->f_instance_name->s_thing)
 	faust_ui_manager_gui_update(x->f_ui_manager);
       x->f_next_tick = clock_getsystimeafter(gui_update_time);
@@ -832,6 +2502,27 @@ static t_int *faustgen_tilde_perform_double(t_int *w)
     return (w+9);
 }
 
+static void faustgen_tilde_free_fifo(t_faustgen_tilde *x)
+{
+    if(x->f_fifo_aligned)
+    {
+        freebytes(x->f_fifo_aligned, x->f_fifo_noutputs * (x->f_fifo_size + x->f_fifo_latency) * sizeof(t_sample));
+    }
+    x->f_fifo_aligned = NULL;
+    if(x->f_fifo_outputs)
+    {
+        freebytes(x->f_fifo_outputs, x->f_fifo_noutputs * sizeof(t_sample*));
+    }
+    x->f_fifo_outputs = NULL;
+    if(x->f_fifo_ptrs)
+    {
+        freebytes(x->f_fifo_ptrs, x->f_fifo_noutputs * sizeof(t_sample*));
+    }
+    x->f_fifo_ptrs = NULL;
+    x->f_fifo_noutputs = 0;
+    x->f_fifo_size = x->f_fifo_fill = x->f_fifo_count = x->f_fifo_latency = 0;
+}
+
 static void faustgen_tilde_free_signals(t_faustgen_tilde *x)
 {
     if(x->f_signal_aligned_single)
@@ -855,6 +2546,62 @@ static void faustgen_tilde_free_signals(t_faustgen_tilde *x)
         free(x->f_signal_matrix_double);
     }
     x->f_signal_matrix_double = NULL;
+    
+    if(x->f_signal_offsets)
+    {
+        free(x->f_signal_offsets);
+    }
+    x->f_signal_offsets = NULL;
+    x->f_nsignals = 0;
+    x->f_memory = 0;
+    
+    faust_resampler_free(x->f_resampler);
+    x->f_resampler = NULL;
+    
+    faustgen_tilde_free_fifo(x);
+}
+
+static int faustgen_tilde_gcd(int a, int b)
+{
+    while(b)
+    {
+        int const t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// The output FIFO starts out with f_fifo_latency samples of silence. Since
+// the input FIFO holds at most size-gcd(size,nsamples) samples when a Pd
+// block is done, this is the smallest latency which never lets the output
+// run dry.
+static void faustgen_tilde_alloc_fifo(t_faustgen_tilde *x, size_t const noutputs, int const size, int const nsamples)
+{
+    size_t i;
+    long memory;
+    int const latency = size - faustgen_tilde_gcd(size, nsamples);
+    x->f_fifo_outputs = (t_sample **)getbytes((noutputs + 1) * sizeof(t_sample*));
+    x->f_fifo_ptrs    = (t_sample **)getbytes((noutputs + 1) * sizeof(t_sample*));
+    x->f_fifo_aligned = (t_sample *)getzbytes(((noutputs + 1) * (size + latency)) * sizeof(t_sample));
+    x->f_fifo_noutputs = noutputs + 1;
+    x->f_fifo_size    = size;
+    x->f_fifo_latency = latency;
+    if(!x->f_fifo_outputs || !x->f_fifo_ptrs || !x->f_fifo_aligned)
+    {
+        // fall back to computing the internal blocks without a fifo
+        pd_error(x, "faustgen2~: memory allocation failed - fifo");
+        faustgen_tilde_free_fifo(x);
+        return;
+    }
+    for(i = 0; i < noutputs; ++i)
+    {
+        x->f_fifo_outputs[i] = x->f_fifo_aligned + i * (size + latency);
+    }
+    x->f_fifo_fill  = 0;
+    x->f_fifo_count = latency;
+    memory = (long)((noutputs + 1) * ((size + latency) * sizeof(t_sample) + 2 * sizeof(t_sample*)));
+    x->f_memory += memory;
 }
 
 static void faustgen_tilde_alloc_signals_single(t_faustgen_tilde *x, size_t const ninputs, size_t const noutputs, size_t const nsamples)
@@ -877,6 +2624,14 @@ static void faustgen_tilde_alloc_signals_single(t_faustgen_tilde *x, size_t cons
     {
         x->f_signal_matrix_single[i] = (x->f_signal_aligned_single+(i*nsamples));
     }
+    x->f_signal_offsets = (void **)malloc((ninputs + noutputs) * sizeof(void *));
+    if(!x->f_signal_offsets)
+    {
+        pd_error(x, "memory allocation failed");
+        return;
+    }
+    x->f_nsignals = ninputs + noutputs;
+    x->f_memory   = (long)((ninputs + noutputs) * (nsamples * sizeof(float) + sizeof(float *) + sizeof(void *)));
 }
 
 static void faustgen_tilde_alloc_signals_double(t_faustgen_tilde *x, size_t const ninputs, size_t const noutputs, size_t const nsamples)
@@ -899,29 +2654,86 @@ static void faustgen_tilde_alloc_signals_double(t_faustgen_tilde *x, size_t cons
     {
         x->f_signal_matrix_double[i] = (x->f_signal_aligned_double+(i*nsamples));
     }
+    x->f_signal_offsets = (void **)malloc((ninputs + noutputs) * sizeof(void *));
+    if(!x->f_signal_offsets)
+    {
+        pd_error(x, "memory allocation failed");
+        return;
+    }
+    x->f_nsignals = ninputs + noutputs;
+    x->f_memory   = (long)((ninputs + noutputs) * (nsamples * sizeof(double) + sizeof(double *) + sizeof(void *)));
 }
 
 static void faustgen_tilde_dsp(t_faustgen_tilde *x, t_signal **sp)
 {
     if(x->f_dsp_instance)
     {
-        char initialized = getSampleRateCDSPInstance(x->f_dsp_instance) != sp[0]->s_sr;
+        // ag: a dsp without any signal iolets (e.g., an LFO which is only
+        // used through its passive controls) gets an empty signal vector,
+        // use Pd's sample rate and block size then
+        bool const nosignals = !faust_io_manager_get_ninputs(x->f_io_manager) &&
+            !faust_io_manager_get_noutputs(x->f_io_manager);
+        t_float const samplerate = nosignals ? sys_getsr() : sp[0]->s_sr;
+        size_t const blocksize = nosignals ? (size_t)sys_getblksize() : (size_t)sp[0]->s_n;
+        // an internal block size larger than Pd's needs a fifo; in
+        // control-rate mode the dsp runs once per Pd block, so resampling
+        // and the internal block size don't apply there
+        int const fifosize = !x->f_controlrate && x->f_iblocksize > (int)blocksize ? x->f_iblocksize : 0;
+        size_t const nsamples = fifosize ? (size_t)fifosize : blocksize;
+        int decimate = x->f_controlrate ? 1 : x->f_decimate;
+        int factor;
+        int sr;
+        char initialized;
+        if(decimate > 1 && (nsamples % decimate || (x->f_iblocksize > 0 && x->f_iblocksize % decimate)))
+        {
+            pd_error(x, "faustgen2~: block size %d is not a multiple of the decimation factor %d - decimation disabled",
+                     x->f_iblocksize > 0 ? x->f_iblocksize : (int)blocksize, decimate);
+            decimate = 1;
+        }
+        factor = x->f_controlrate ? 1 : decimate > 1 ? decimate : x->f_oversample;
+        sr = x->f_controlrate ? (int)(samplerate / blocksize) :
+            decimate > 1 ? (int)samplerate / decimate : (int)samplerate * x->f_oversample;
+        initialized = getSampleRateCDSPInstance(x->f_dsp_instance) != sr;
+        // pending events (if any) take effect right away
+        faust_ui_manager_apply_events(x->f_ui_manager, -1);
         if(initialized)
         {
+            size_t i;
             faust_ui_manager_save_states(x->f_ui_manager);
-            initCDSPInstance(x->f_dsp_instance, sp[0]->s_sr);
+            initCDSPInstance(x->f_dsp_instance, sr);
+            for(i = 1; i < x->f_ninstances; ++i)
+            {
+                initCDSPInstance(x->f_instances[i], sr);
+            }
+            if(x->f_effect_instance)
+            {
+                initCDSPInstance(x->f_effect_instance, sr);
+            }
         }
         if(!faust_io_manager_prepare(x->f_io_manager, sp))
         {
             size_t const ninputs  = faust_io_manager_get_ninputs(x->f_io_manager);
             size_t const noutputs = faust_io_manager_get_noutputs(x->f_io_manager);
-            size_t const nsamples = (size_t)sp[0]->s_n;
+            // scratch buffers for the voice outputs and the voice mix; in
+            // ganged mode all instances share the same output buffers instead
+            size_t const nscratch = x->f_ninstances ?
+                (x->f_effect_instance ? 2 : 1) * x->f_voice_noutputs : 0;
+            size_t const nbuffers = x->f_gang && x->f_ninstances ?
+                noutputs / x->f_ninstances : noutputs + nscratch;
+            x->f_samplerate = samplerate;
+            x->f_blocksize  = (int)blocksize;
+            faustgen_tilde_set_autosleep(x, x->f_sleep_time, x->f_sleep_level);
+            x->f_tick_time  = clock_getlogicaltime();
 
             if(faust_opt_has_double_precision(x->f_opt_manager))
             {
-                faustgen_tilde_alloc_signals_double(x, ninputs, noutputs, nsamples);
+                faustgen_tilde_alloc_signals_double(x, ninputs, nbuffers, nsamples);
+                if(factor > 1)
+                {
+                    x->f_resampler = faust_resampler_new((t_object *)x, factor, decimate > 1, ninputs, noutputs, nbuffers, nsamples, 1);
+                }
                 dsp_add((t_perfroutine)faustgen_tilde_perform_double, 8,
-                        (t_int)x->f_dsp_instance, (t_int)nsamples, (t_int)ninputs, (t_int)noutputs,
+                        (t_int)x->f_dsp_instance, (t_int)blocksize, (t_int)ninputs, (t_int)noutputs,
                         (t_int)x->f_signal_matrix_double,
                         (t_int)faust_io_manager_get_input_signals(x->f_io_manager),
                         (t_int)faust_io_manager_get_output_signals(x->f_io_manager),
@@ -929,14 +2741,23 @@ static void faustgen_tilde_dsp(t_faustgen_tilde *x, t_signal **sp)
             }
             else
             {
-                faustgen_tilde_alloc_signals_single(x, ninputs, noutputs, nsamples);
+                faustgen_tilde_alloc_signals_single(x, ninputs, nbuffers, nsamples);
+                if(factor > 1)
+                {
+                    x->f_resampler = faust_resampler_new((t_object *)x, factor, decimate > 1, ninputs, noutputs, nbuffers, nsamples, 0);
+                }
                 dsp_add((t_perfroutine)faustgen_tilde_perform_single, 8,
-                        (t_int)x->f_dsp_instance, (t_int)nsamples, (t_int)ninputs, (t_int)noutputs,
+                        (t_int)x->f_dsp_instance, (t_int)blocksize, (t_int)ninputs, (t_int)noutputs,
                         (t_int)x->f_signal_matrix_single,
                         (t_int)faust_io_manager_get_input_signals(x->f_io_manager),
                         (t_int)faust_io_manager_get_output_signals(x->f_io_manager),
                         (t_int)x);
             }
+            if(fifosize)
+            {
+                faustgen_tilde_alloc_fifo(x, noutputs, fifosize, (int)blocksize);
+            }
+            faustgen_tilde_update_memory(x);
         }
         if(initialized)
         {
@@ -989,6 +2810,13 @@ static void faustgen_tilde_free(t_faustgen_tilde *x)
     faust_io_manager_free(x->f_io_manager);
     faust_opt_manager_free(x->f_opt_manager);
     faustgen_tilde_free_signals(x);
+    faust_stats_free(x->f_load);
+    if(x->f_perf)
+    {
+        faust_perf_free(x->f_perf);
+    }
+    faust_stats_registry_instances(x->f_stats, -1);
+    faust_stats_registry_memory(x->f_stats, -x->f_memory_reported);
 }
 
 static t_symbol *real_dsp_name(t_symbol *s)
@@ -1006,6 +2834,28 @@ static t_symbol *real_dsp_name(t_symbol *s)
   return gensym(buf);
 }
 
+// ag: Source file and compile options of the dsp, which identify a compile
+// in the load profile.
+static t_symbol *faustgen_tilde_get_source(t_faustgen_tilde *x)
+{
+  char buf[MAXPDSTRING];
+  size_t i, noptions = faust_opt_manager_get_noptions(x->f_opt_manager);
+  char const** options = faust_opt_manager_get_options(x->f_opt_manager);
+  int n = snprintf(buf, MAXPDSTRING, "%s",
+                   faust_opt_manager_get_full_path(x->f_opt_manager, x->f_dsp_name->s_name));
+  for (i = 0; i < noptions && n < MAXPDSTRING; i++)
+    n += snprintf(buf+n, MAXPDSTRING-n, " %s", options[i]);
+  return gensym(buf);
+}
+
+static void faustgen_tilde_profileload(t_faustgen_tilde *x, t_floatarg f)
+{
+  // ag: Patch-load profiling, usually sent to all objects through the global
+  // faustgen2~ receiver before opening a patch. This can also be enabled by
+  // setting the FAUSTGEN2_PROFILELOAD environment variable.
+  faust_stats_profile_enable(f != 0);
+}
+
 static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
 {
     t_faustgen_tilde* x = (t_faustgen_tilde *)pd_new(faustgen_tilde_class);
@@ -1017,17 +2867,60 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
         sprintf(default_file, "%s/default", class_gethelpdir(faustgen_tilde_class));
         x->f_dsp_factory    = NULL;
         x->f_dsp_instance   = NULL;
+        x->f_instances      = NULL;
+        x->f_ninstances     = 0;
+        x->f_voice_noutputs = 0;
+        x->f_effect_factory   = NULL;
+        x->f_effect_instance  = NULL;
+        x->f_gang           = 0;
+        x->f_mc             = 0;
         
         x->f_signal_matrix_single  = NULL;
         x->f_signal_aligned_single = NULL;
         x->f_signal_matrix_double  = NULL;
         x->f_signal_aligned_double = NULL;
+        x->f_signal_offsets        = NULL;
+        x->f_nsignals              = 0;
+        x->f_accurate              = 0;
+        x->f_tick_time             = clock_getlogicaltime();
+        x->f_samplerate            = 0;
+        x->f_blocksize             = 0;
+        x->f_oversample            = 1;
+        x->f_decimate              = 1;
+        x->f_resampler             = NULL;
+        x->f_controlrate           = false;
+        x->f_sleep_time            = 0;
+        x->f_sleep_level           = SLEEP_LEVEL;
+        x->f_sleep_tail            = 0;
+        x->f_sleep_quiet           = 0;
+        x->f_asleep                = false;
+        x->f_wakeup                = false;
+        x->f_sleep_skipped         = 0;
+        x->f_load                  = NULL;
+        x->f_perf                  = NULL;
+        x->f_render                = NULL;
+        x->f_bench                 = NULL;
+        x->f_stats                 = NULL;
+        x->f_memory                = 0;
+        x->f_memory_reported       = 0;
+        memset(x->f_compile_time, 0, sizeof(x->f_compile_time));
+        x->f_iblocksize            = 0;
+        x->f_fifo_size             = 0;
+        x->f_fifo_fill             = 0;
+        x->f_fifo_count            = 0;
+        x->f_fifo_latency          = 0;
+        x->f_fifo_noutputs         = 0;
+        x->f_fifo_outputs          = NULL;
+        x->f_fifo_ptrs             = NULL;
+        x->f_fifo_aligned          = NULL;
         
         x->f_ui_manager     = faust_ui_manager_new((t_object *)x);
         x->f_io_manager     = faust_io_manager_new((t_object *)x, x->f_canvas);
         x->f_opt_manager    = faust_opt_manager_new((t_object *)x, x->f_canvas);
         x->f_dsp_name       = is_loader_obj ? real_dsp_name(s) :
 	  argc ? atom_getsymbolarg(0, argc, argv) : gensym(default_file);
+        x->f_stats          = faust_stats_registry_get(x->f_dsp_name);
+        faust_stats_registry_instances(x->f_stats, 1);
         x->f_clock          = clock_new(x, (t_method)faustgen_tilde_autocompile_tick);
         x->f_midiout = x->f_oscout = false;
         x->f_midichan = -1;
@@ -1081,6 +2974,107 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
                   x->f_oscout = num != 0;
                 else
                   x->f_oscrecv = gensym(arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "mc=",
+				 strlen("mc=")) == 0) {
+                // multichannel iolets; this can be empty (one multichannel
+                // inlet and outlet, or one per ganged instance) or the
+                // number of multichannel inlets and outlets (0 turns them
+                // off); the channels are split evenly among these
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("mc=");
+                unsigned num;
+                if (!*arg)
+                  x->f_mc = -1;
+                else if (sscanf(arg, "%u", &num) == 1)
+                  x->f_mc = (int)num;
+                if (x->f_mc && !faust_io_manager_has_multichannel()) {
+                  pd_error(x, "faustgen2~: multichannel signals need Pd 0.54 or later");
+                  x->f_mc = 0;
+                }
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "accurate=",
+				 strlen("accurate=")) == 0) {
+                // sample-accurate timing; this can be empty (turning it on
+                // with a minimum sub-block size of 1) or the minimum
+                // sub-block size (0 turns it off)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("accurate=");
+                unsigned num;
+                if (!*arg)
+                  faustgen_tilde_set_accurate(x, 1);
+                else if (sscanf(arg, "%u", &num) == 1)
+                  faustgen_tilde_set_accurate(x, (int)num);
+                else
+                  pd_error(x, "faustgen2~: bad sub-block size '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "oversample=",
+				 strlen("oversample=")) == 0) {
+                // oversampling factor, the dsp runs at this multiple of
+                // Pd's sample rate (1 turns oversampling off)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("oversample=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1 && num >= 1 &&
+                    num <= FAUST_RESAMPLER_MAXFACTOR) {
+                  x->f_oversample = (int)num;
+                  if (num > 1) x->f_decimate = 1;
+                } else
+                  pd_error(x, "faustgen2~: bad oversampling factor '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "decimate=",
+				 strlen("decimate=")) == 0) {
+                // decimation factor, the dsp runs at this fraction of Pd's
+                // sample rate (1 turns decimation off)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("decimate=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1 && num >= 1 &&
+                    num <= FAUST_RESAMPLER_MAXFACTOR) {
+                  x->f_decimate = (int)num;
+                  if (num > 1) x->f_oversample = 1;
+                } else
+                  pd_error(x, "faustgen2~: bad decimation factor '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "controlrate=",
+				 strlen("controlrate=")) == 0) {
+                // control-rate flag; this can be empty (turning on
+                // control-rate mode) or an integer (turning it off or on,
+                // depending on whether the value is zero or not)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("controlrate=");
+                unsigned num;
+                x->f_controlrate = !*arg || (sscanf(arg, "%u", &num) == 1 && num != 0);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "autosleep=",
+				 strlen("autosleep=")) == 0) {
+                // auto-sleep; this can be empty (turning it on with the
+                // default tail time) or the tail time in msecs (0 turns it
+                // off)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("autosleep=");
+                double time;
+                if (!*arg)
+                  faustgen_tilde_set_autosleep(x, SLEEP_TAIL_TIME, SLEEP_LEVEL);
+                else if (sscanf(arg, "%lf", &time) == 1)
+                  faustgen_tilde_set_autosleep(x, time, SLEEP_LEVEL);
+                else
+                  pd_error(x, "faustgen2~: bad tail time '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "load=",
+				 strlen("load=")) == 0) {
+                // load meter flag; this can be empty (turning on the meter)
+                // or an integer (turning it off or on, depending on whether
+                // the value is zero or not)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("load=");
+                unsigned num;
+                faustgen_tilde_set_load(x, !*arg || (sscanf(arg, "%u", &num) == 1 && num != 0));
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "blocksize=",
+				 strlen("blocksize=")) == 0) {
+                // internal block size of the dsp (0 means Pd's block size)
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("blocksize=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1)
+                  x->f_iblocksize = (int)num;
+                else
+                  pd_error(x, "faustgen2~: bad block size '%s'", arg);
+              } else if (strncmp(argv->a_w.w_symbol->s_name, "gang=",
+				 strlen("gang=")) == 0) {
+                // ganged mode; the number of dsp instances to run side by
+                // side in this object, each with its own signal iolets
+                const char *arg = argv->a_w.w_symbol->s_name+strlen("gang=");
+                unsigned num;
+                if (sscanf(arg, "%u", &num) == 1)
+                  x->f_gang = num > 1 ? num : 0;
+                else
+                  pd_error(x, "faustgen2~: bad gang size '%s'", arg);
               } else {
                 // the instance name is used as an additional identifier of
                 // the dsp in the receivers (see below); the plan is to also
@@ -1115,9 +3109,15 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
 	  pd_bind(&x->f_obj.ob_pd,
 		  make_instance_name(x->f_dsp_name, x->f_instance_name));
 	  // create the Pd GUI
+	  double const span = faust_stats_gettime();
 	  faust_ui_manager_gui(x->f_ui_manager,
 			       x->f_unique_name, x->f_instance_name);
+	  faustgen_tilde_end_stage(x, FAUSTGEN_STAGE_GUI, span);
 	}
+	if (faust_stats_profile_enabled())
+	  faust_stats_profile_add(x->f_unique_name, faustgen_tilde_get_source(x),
+				  FAUSTGEN_STAGE_TOTAL, faustgen_compile_stages,
+				  x->f_compile_time);
 	// ag: kick off GUI updates every gui_update_time msecs (we do this
 	// even if the GUI wasn't created yet, in case it may created later)
 	x->f_next_tick = clock_getsystimeafter(gui_update_time);
@@ -1146,12 +3146,16 @@ static void *faustgen_tilde_new(t_symbol* s, int argc, t_atom* argv)
 # define UNUSED(x) x
 #endif
 
+// ag: class flags; this includes CLASS_MULTICHANNEL if the running Pd
+// version supports multichannel signals (Pd 0.54+)
+static int faustgen_class_flags = CLASS_DEFAULT;
+
 static int faustgen_loader(t_symbol *name)
 {
   t_class* c = class_new(name,
 			 (t_newmethod)faustgen_tilde_new,
 			 (t_method)faustgen_tilde_free,
-			 sizeof(t_faustgen_tilde), CLASS_DEFAULT, A_GIMME, 0);
+			 sizeof(t_faustgen_tilde), faustgen_class_flags, A_GIMME, 0);
   if (c) {
     class_addmethod(c,  (t_method)faustgen_tilde_dsp,               gensym("dsp"),              A_CANT, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_compile,           gensym("compile"),          A_NULL, 0);
@@ -1165,6 +3169,22 @@ static int faustgen_loader(t_symbol *name)
     class_addmethod(c,  (t_method)faustgen_tilde_oscout,            gensym("oscout"),           A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midiout,           gensym("midiout"),          A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midichan,          gensym("midichan"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_instance,          gensym("instance"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_accurate,          gensym("accurate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_oversample,        gensym("oversample"),       A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_decimate,          gensym("decimate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_blocksize,         gensym("blocksize"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_controlrate,       gensym("controlrate"),      A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_autosleep,         gensym("autosleep"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_latency,           gensym("latency"),          A_NULL, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_load,              gensym("load"),             A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_stats,             gensym("stats"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_trace,             gensym("trace"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_profileload,       gensym("profileload"),      A_FLOAT, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_ctlbench,          gensym("ctlbench"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_perfcount,         gensym("perfcount"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_bench,             gensym("bench"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_render,            gensym("render"),           A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_menu_open,         gensym("click"),            A_NULL, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_menu_open,         gensym("menu-open"),        A_NULL, 0);
     class_addbang(c, (t_method)faustgen_tilde_allnotesoff);
@@ -1216,6 +3236,9 @@ static int faustgen_loader_legacy(t_canvas *canvas, char *name)
 
 void faustgen2_tilde_setup(void)
 {
+  // load profiling from the start, so that it covers the startup patches
+  if (getenv("FAUSTGEN2_PROFILELOAD"))
+    faust_stats_profile_enable(1);
   // register the faustgen2~ loader
   int major = 0, minor = 0, patchlevel = 0;
   sys_getversion(&major, &minor, &patchlevel);
@@ -1225,11 +3248,26 @@ void faustgen2_tilde_setup(void)
   else
     // since Pd>=0.47, Pd tries the loaders for each path
     sys_register_loader((loader_t)faustgen_loader_pathwise);
+#ifdef CLASS_MULTICHANNEL
+  // check for multichannel support (Pd 0.54+)
+  {
+    t_setmultiout setmultiout;
+#ifdef _WIN32
+    setmultiout = (t_setmultiout)GetProcAddress(GetModuleHandleA("pd.dll"), "signal_setmultiout");
+#else
+    setmultiout = (t_setmultiout)dlsym(RTLD_DEFAULT, "signal_setmultiout");
+#endif
+    if (setmultiout) {
+      faust_io_manager_setup(setmultiout);
+      faustgen_class_flags |= CLASS_MULTICHANNEL;
+    }
+  }
+#endif
   // register the faustgen2~ class
   t_class* c = class_new(gensym("faustgen2~"),
 			 (t_newmethod)faustgen_tilde_new,
 			 (t_method)faustgen_tilde_free,
-			 sizeof(t_faustgen_tilde), CLASS_DEFAULT, A_GIMME, 0);
+			 sizeof(t_faustgen_tilde), faustgen_class_flags, A_GIMME, 0);
     
   if (c) {
     class_addmethod(c,  (t_method)faustgen_tilde_dsp,               gensym("dsp"),              A_CANT, 0);
@@ -1244,6 +3282,22 @@ void faustgen2_tilde_setup(void)
     class_addmethod(c,  (t_method)faustgen_tilde_oscout,            gensym("oscout"),           A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midiout,           gensym("midiout"),          A_GIMME, 0);
     class_addmethod(c,  (t_method)faustgen_tilde_midichan,          gensym("midichan"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_instance,          gensym("instance"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_accurate,          gensym("accurate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_oversample,        gensym("oversample"),       A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_decimate,          gensym("decimate"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_blocksize,         gensym("blocksize"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_controlrate,       gensym("controlrate"),      A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_autosleep,         gensym("autosleep"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_latency,           gensym("latency"),          A_NULL, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_load,              gensym("load"),             A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_stats,             gensym("stats"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_trace,             gensym("trace"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_profileload,       gensym("profileload"),      A_FLOAT, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_ctlbench,          gensym("ctlbench"),         A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_perfcount,         gensym("perfcount"),        A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_bench,             gensym("bench"),            A_GIMME, 0);
+    class_addmethod(c,  (t_method)faustgen_tilde_render,            gensym("render"),           A_GIMME, 0);
 #if 0
     class_addmethod(c,  (t_method)faustgen_tilde_open_texteditor,   gensym("click"),            A_NULL, 0);
 #endif
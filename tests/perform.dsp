@@ -0,0 +1,4 @@
+declare name 		"perform";
+declare description	"gain stage for the perform test (perform.pd)";
+
+process = _ * hslider("gain", 0, 0, 1, 0.001);